@@ -0,0 +1,79 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// Component storage as it was before the sparse-set pools: a hash map from
+// entity ID to dense index per pool, pools held by shared_ptr and cast on
+// every access. Kept only so the benchmarks can show the difference.
+namespace baseline {
+
+class IPool {
+public:
+    virtual ~IPool() = default;
+};
+
+template <typename T> class Pool : public IPool {
+private:
+    std::vector<T> data;
+    std::unordered_map<int, int> entityIdToIndex;
+    std::unordered_map<int, int> indexToEntityId;
+
+public:
+    void Set(int entityId, T object) {
+        const int index = data.size();
+        entityIdToIndex.emplace(entityId, index);
+        indexToEntityId.emplace(index, entityId);
+        data.push_back(object);
+    }
+
+    T &Get(int entityId) { return data[entityIdToIndex[entityId]]; }
+};
+
+class Registry {
+private:
+    // Vector index = component slot
+    std::vector<std::shared_ptr<IPool>> componentPools;
+
+public:
+    template <typename T> void AddComponent(int slot, int entityId, T object) {
+        if (slot >= static_cast<int>(componentPools.size())) {
+            componentPools.resize(slot + 1);
+        }
+        if (!componentPools[slot]) {
+            componentPools[slot] = std::make_shared<Pool<T>>();
+        }
+        std::static_pointer_cast<Pool<T>>(componentPools[slot])
+            ->Set(entityId, object);
+    }
+
+    template <typename T> T &GetComponent(int slot, int entityId) const {
+        const auto pool =
+            std::static_pointer_cast<Pool<T>>(componentPools[slot]);
+        return pool->Get(entityId);
+    }
+};
+
+} // namespace baseline
+
+// Runs frame() repeatedly and returns the best average milliseconds per
+// frame over several rounds, which filters out scheduling noise
+template <typename TFunc>
+double MeasureMillisPerFrame(int rounds, int frames, TFunc frame) {
+    double best = 0;
+    for (int round = 0; round < rounds; round++) {
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < frames; i++) {
+            frame();
+        }
+        const std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - start;
+        const double millis = elapsed.count() / frames;
+        if (round == 0 || millis < best) {
+            best = millis;
+        }
+    }
+    return best;
+}
@@ -0,0 +1,90 @@
+#include "../../src/Components/BoxColliderComponent.h"
+#include "../../src/Components/PositionComponent.h"
+#include "../../src/ECS/Prefab.h"
+#include "BaselineStorage.h"
+#include <cstdio>
+#include <vector>
+
+// Collision-heavy scene: every pair of colliders is tested, looking up both
+// entities' position and collider for each pair
+static const int NUM_COLLIDERS = 3000;
+
+static glm::vec2 StartPosition(int index) {
+    return glm::vec2(index % 100 * 10, index / 100 * 10);
+}
+
+template <typename TPosition, typename TCollider>
+static bool Overlaps(
+    const TPosition &a,
+    const TCollider &aCollider,
+    const TPosition &b,
+    const TCollider &bCollider
+) {
+    return a.position.x < b.position.x + bCollider.width &&
+           a.position.x + aCollider.width > b.position.x &&
+           a.position.y < b.position.y + bCollider.height &&
+           a.position.y + aCollider.height > b.position.y;
+}
+
+static double BenchBaseline(int &hits) {
+    baseline::Registry registry;
+    for (int i = 0; i < NUM_COLLIDERS; i++) {
+        registry.AddComponent(0, i, PositionComponent(StartPosition(i)));
+        registry.AddComponent(1, i, BoxColliderComponent(12, 12));
+    }
+    return MeasureMillisPerFrame(3, 2, [&] {
+        hits = 0;
+        for (int a = 0; a < NUM_COLLIDERS; a++) {
+            for (int b = a + 1; b < NUM_COLLIDERS; b++) {
+                hits += Overlaps(
+                    registry.GetComponent<PositionComponent>(0, a),
+                    registry.GetComponent<BoxColliderComponent>(1, a),
+                    registry.GetComponent<PositionComponent>(0, b),
+                    registry.GetComponent<BoxColliderComponent>(1, b)
+                );
+            }
+        }
+    });
+}
+
+static double BenchRegistry(int &hits) {
+    Registry registry;
+    Prefab prefab;
+    prefab.AddComponent<PositionComponent>()
+        .AddComponent<BoxColliderComponent>(12, 12);
+    const auto entities = registry.Instantiate(
+        prefab,
+        NUM_COLLIDERS,
+        [](Entity entity, int index) {
+            entity.GetComponent<PositionComponent>().position =
+                StartPosition(index);
+        }
+    );
+    return MeasureMillisPerFrame(3, 2, [&] {
+        hits = 0;
+        for (auto a = entities.begin(); a != entities.end(); a++) {
+            for (auto b = a + 1; b != entities.end(); b++) {
+                hits += Overlaps(
+                    a->GetComponent<PositionComponent>(),
+                    a->GetComponent<BoxColliderComponent>(),
+                    b->GetComponent<PositionComponent>(),
+                    b->GetComponent<BoxColliderComponent>()
+                );
+            }
+        }
+    });
+}
+
+int main() {
+    int baselineHits = 0;
+    int registryHits = 0;
+    const double baselineMillis = BenchBaseline(baselineHits);
+    const double registryMillis = BenchRegistry(registryHits);
+    std::printf(
+        "CollisionBench, %d colliders, four lookups per pair, ms/frame\n",
+        NUM_COLLIDERS
+    );
+    std::printf("  shared_ptr cast + hash map pools: %.1f\n", baselineMillis);
+    std::printf("  GetPool + sparse-set pools:       %.1f\n", registryMillis);
+    return baselineHits == registryHits ? 0 : 1;
+}
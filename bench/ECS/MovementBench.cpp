@@ -0,0 +1,136 @@
+#include "../../src/Components/PositionComponent.h"
+#include "../../src/Components/RigidBodyComponent.h"
+#include "../../src/ECS/Prefab.h"
+#include "../../src/Systems/MovementKernel.h"
+#include "BaselineStorage.h"
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+// MovementSystem-style integration of 100k entities, one thread
+static const int NUM_ENTITIES = 100000;
+static const float DELTA_TIME = 0.016f;
+static const float MAP_WIDTH = 1000;
+static const float MAP_HEIGHT = 100;
+
+class MoveSystem : public System {
+public:
+    MoveSystem() {
+        RequireComponent<PositionComponent>();
+        RequireComponent<RigidBodyComponent>();
+    }
+
+    void Update() {
+        for (auto entity : GetSystemEntities()) {
+            auto &position = entity.GetComponent<PositionComponent>();
+            const auto &rigidBody = entity.GetComponent<RigidBodyComponent>();
+            position.position += rigidBody.velocity * DELTA_TIME;
+        }
+    }
+};
+
+// What MovementSystem does: align both pools with the system entities, then
+// run the kernel down the columns page by page
+class ColumnMoveSystem : public System {
+private:
+    std::vector<int> outside;
+
+public:
+    int numOutside = 0;
+
+    ColumnMoveSystem() {
+        RequireComponent<PositionComponent>();
+        RequireComponent<RigidBodyComponent>();
+    }
+
+    void Update(Registry &registry) {
+        const auto &entities = GetSystemEntities();
+        registry.SortAs<PositionComponent>(entities);
+        registry.SortAs<RigidBodyComponent>(entities);
+        auto &positions = registry.GetPool<PositionComponent>();
+        auto &rigidBodies = registry.GetPool<RigidBodyComponent>();
+        const int pageSize = Pool<PositionComponent>::PAGE_SIZE;
+        const int count = entities.size();
+
+        numOutside = 0;
+        outside.resize(pageSize);
+        for (int first = 0; first < count; first += pageSize) {
+            const int pageCount = std::min(pageSize, count - first);
+            numOutside += MovementKernel::Integrate(
+                &positions[first].position.x,
+                &rigidBodies[first].velocity.x,
+                pageCount,
+                DELTA_TIME,
+                MAP_WIDTH,
+                MAP_HEIGHT,
+                outside.data()
+            );
+            const auto *rigidBody = &rigidBodies[first];
+            positions.MarkChangedWhere(first, pageCount, [&](int i) {
+                const auto &velocity = rigidBody[i].velocity;
+                return velocity.x != 0 || velocity.y != 0;
+            });
+        }
+    }
+};
+
+static glm::vec2 StartPosition(int index) {
+    return glm::vec2(index % 1000, index / 1000);
+}
+static glm::vec2 StartVelocity(int index) {
+    return glm::vec2(index % 13 - 6, index % 11 - 5);
+}
+
+static double BenchBaseline() {
+    baseline::Registry registry;
+    std::vector<int> entityIds;
+    for (int i = 0; i < NUM_ENTITIES; i++) {
+        registry.AddComponent(0, i, PositionComponent(StartPosition(i)));
+        registry.AddComponent(1, i, RigidBodyComponent(StartVelocity(i)));
+        entityIds.push_back(i);
+    }
+    return MeasureMillisPerFrame(5, 20, [&] {
+        for (const int entityId : entityIds) {
+            auto &position =
+                registry.GetComponent<PositionComponent>(0, entityId);
+            const auto &rigidBody =
+                registry.GetComponent<RigidBodyComponent>(1, entityId);
+            position.position += rigidBody.velocity * DELTA_TIME;
+        }
+    });
+}
+
+template <typename TSystem> static TSystem &AddMovers(Registry &registry) {
+    registry.AddSystem<TSystem>();
+    Prefab prefab;
+    prefab.AddComponent<PositionComponent>()
+        .AddComponent<RigidBodyComponent>();
+    registry.Instantiate(prefab, NUM_ENTITIES, [](Entity entity, int index) {
+        entity.GetComponent<PositionComponent>().position =
+            StartPosition(index);
+        entity.GetComponent<RigidBodyComponent>().velocity =
+            StartVelocity(index);
+    });
+    registry.Update();
+    return registry.GetSystem<TSystem>();
+}
+
+static double BenchRegistry() {
+    Registry registry;
+    auto &system = AddMovers<MoveSystem>(registry);
+    return MeasureMillisPerFrame(5, 20, [&] { system.Update(); });
+}
+
+static double BenchColumns() {
+    Registry registry;
+    auto &system = AddMovers<ColumnMoveSystem>(registry);
+    return MeasureMillisPerFrame(5, 20, [&] { system.Update(registry); });
+}
+
+int main() {
+    std::printf("MovementBench, %d entities, ms/frame\n", NUM_ENTITIES);
+    std::printf("  hash map pools, per entity:   %.3f\n", BenchBaseline());
+    std::printf("  sparse-set pools, per entity: %.3f\n", BenchRegistry());
+    std::printf("  aligned columns, SIMD kernel: %.3f\n", BenchColumns());
+    return 0;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "../ECS/TypeList.h"
+
+struct TransformComponent;
+struct RigidBodyComponent;
+struct SpriteComponent;
+struct AnimationComponent;
+struct BoxColliderComponent;
+struct KeyboardControlledComponent;
+struct CameraFollowComponent;
+struct ProjectileEmitterComponent;
+struct HealthComponent;
+struct ProjectileComponent;
+struct TextLabelComponent;
+struct DisabledComponent;
+struct PositionComponent;
+template <typename T> class Shared;
+
+// A component's position in this list is its ID, the same in every build, so
+// IDs may be stored in saved data. Append new components at the end.
+using ComponentTypes = TypeList<
+    TransformComponent,
+    RigidBodyComponent,
+    SpriteComponent,
+    AnimationComponent,
+    BoxColliderComponent,
+    KeyboardControlledComponent,
+    CameraFollowComponent,
+    ProjectileEmitterComponent,
+    HealthComponent,
+    ProjectileComponent,
+    TextLabelComponent,
+    DisabledComponent,
+    Shared<SpriteComponent>,
+    PositionComponent>;
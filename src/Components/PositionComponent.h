@@ -0,0 +1,12 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// Kept apart from TransformComponent so positions are packed in their own
+// pool, next to each other, for MovementSystem to integrate
+struct PositionComponent {
+    glm::vec2 position;
+
+    PositionComponent(glm::vec2 position = glm::vec2(0, 0))
+        : position(position) {}
+};
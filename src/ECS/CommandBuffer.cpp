@@ -0,0 +1,125 @@
+#include "CommandBuffer.h"
+#include "Prefab.h"
+#include <stdexcept>
+
+const Entity *CommandBuffer::Resolve(
+    const Registry &registry,
+    const std::vector<Entity> &createdEntities,
+    const Target &target
+) {
+    const Entity *entity = std::get_if<Entity>(&target);
+    if (!entity) {
+        entity = &createdEntities[std::get<NewEntity>(target).index];
+    }
+    return registry.IsAlive(*entity) ? entity : nullptr;
+}
+
+NewEntity CommandBuffer::CreateEntity() {
+    createdPrefabs.push_back(nullptr);
+    return NewEntity{static_cast<int>(createdPrefabs.size()) - 1};
+}
+
+NewEntity CommandBuffer::Instantiate(const Prefab &prefab) {
+    createdPrefabs.push_back(&prefab);
+    return NewEntity{static_cast<int>(createdPrefabs.size()) - 1};
+}
+
+void CommandBuffer::Kill(Target target) { kills.push_back(target); }
+
+// IDs are checked while recording so playback cannot fail halfway
+void CommandBuffer::Group(Target target, int groupId) {
+    if (groupId < 0 || groupId >= MAX_GROUPS) {
+        throw std::out_of_range("Invalid group ID");
+    }
+    groups.emplace_back(target, groupId);
+}
+
+void CommandBuffer::Tag(Target target, int tagId) {
+    if (tagId < 0 || tagId >= MAX_TAGS) {
+        throw std::out_of_range("Invalid tag ID");
+    }
+    tags.emplace_back(target, tagId);
+}
+
+void CommandBuffer::SetEnabled(Target target, bool enabled) {
+    enables.emplace_back(target, enabled);
+}
+
+bool CommandBuffer::IsEmpty() const {
+    if (!createdPrefabs.empty() || !groups.empty() || !tags.empty() ||
+        !enables.empty() || !kills.empty()) {
+        return false;
+    }
+    for (const auto &commands : componentCommands) {
+        if (commands && !commands->IsEmpty()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void CommandBuffer::Clear() {
+    createdPrefabs.clear();
+    groups.clear();
+    tags.clear();
+    enables.clear();
+    kills.clear();
+    for (auto &commands : componentCommands) {
+        if (commands) {
+            commands->Clear();
+        }
+    }
+}
+
+void CommandBuffer::Playback(Registry &registry) {
+    createdEntities.clear();
+    createdEntities.reserve(createdPrefabs.size());
+    for (size_t i = 0; i < createdPrefabs.size();) {
+        const Prefab *prefab = createdPrefabs[i];
+        if (!prefab) {
+            createdEntities.push_back(registry.CreateEntity());
+            i++;
+            continue;
+        }
+        // Consecutive instances of a prefab are instantiated in one batch
+        size_t end = i + 1;
+        while (end < createdPrefabs.size() && createdPrefabs[end] == prefab) {
+            end++;
+        }
+        const auto instances = registry.Instantiate(*prefab, end - i);
+        createdEntities.insert(
+            createdEntities.end(), instances.begin(), instances.end()
+        );
+        i = end;
+    }
+
+    for (const auto &[target, groupId] : groups) {
+        if (const auto *entity = Resolve(registry, createdEntities, target)) {
+            registry.GroupEntity(*entity, groupId);
+        }
+    }
+    for (const auto &[target, tagId] : tags) {
+        if (const auto *entity = Resolve(registry, createdEntities, target)) {
+            registry.TagEntity(*entity, tagId);
+        }
+    }
+    for (const auto &[target, enabled] : enables) {
+        if (const auto *entity = Resolve(registry, createdEntities, target)) {
+            registry.SetEntityEnabled(*entity, enabled);
+        }
+    }
+
+    for (auto &commands : componentCommands) {
+        if (commands) {
+            commands->Playback(registry, createdEntities);
+        }
+    }
+
+    for (const auto &target : kills) {
+        if (const auto *entity = Resolve(registry, createdEntities, target)) {
+            registry.KillEntity(*entity);
+        }
+    }
+
+    Clear();
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+#include "ECS.h"
+#include <memory>
+#include <optional>
+#include <utility>
+#include <variant>
+#include <vector>
+
+// Placeholder for an entity created by a command buffer, resolved on playback
+struct NewEntity {
+    int index;
+};
+
+// Records structural changes (creating and killing entities, adding and
+// removing components, tagging and grouping) so systems and worker threads
+// never touch registry storage directly. The registry plays its buffers back
+// at the start of Update, batching component additions per type. A buffer
+// must only be recorded from one thread at a time.
+class CommandBuffer {
+private:
+    using Target = std::variant<Entity, NewEntity>;
+
+    struct IComponentCommands {
+        virtual ~IComponentCommands() = default;
+        virtual void Playback(
+            Registry &registry,
+            const std::vector<Entity> &createdEntities
+        ) = 0;
+        virtual bool IsEmpty() const = 0;
+        virtual void Clear() = 0;
+    };
+
+    template <typename TComponent>
+    struct ComponentCommands : public IComponentCommands {
+        // In recorded order, an empty value is a removal
+        std::vector<std::pair<Target, std::optional<TComponent>>> commands;
+        unsigned int numAdditions = 0;
+
+        void Playback(
+            Registry &registry,
+            const std::vector<Entity> &createdEntities
+        ) override;
+        bool IsEmpty() const override {
+            return commands.empty();
+        }
+        void Clear() override {
+            commands.clear();
+            numAdditions = 0;
+        }
+    };
+
+    // Index = NewEntity::index, null for entities created empty
+    std::vector<const Prefab *> createdPrefabs;
+    std::vector<std::pair<Target, int>> groups;
+    std::vector<std::pair<Target, int>> tags;
+    std::vector<std::pair<Target, bool>> enables;
+    std::vector<Target> kills;
+
+    // Vector index = component type ID
+    std::vector<std::unique_ptr<IComponentCommands>> componentCommands;
+
+    // Filled on playback, index = NewEntity::index
+    std::vector<Entity> createdEntities;
+
+    template <typename TComponent>
+    ComponentCommands<TComponent> &GetComponentCommands();
+
+    // Dead entities resolve to null and are skipped
+    static const Entity *Resolve(
+        const Registry &registry,
+        const std::vector<Entity> &createdEntities,
+        const Target &target
+    );
+
+public:
+    NewEntity CreateEntity();
+    // The prefab must outlive playback. Components added to the new entity
+    // in the same buffer replace the prefab's defaults.
+    NewEntity Instantiate(const Prefab &prefab);
+
+    template <typename TComponent, typename... TArgs>
+    void AddComponent(Target target, TArgs &&...args);
+    template <typename TComponent> void RemoveComponent(Target target);
+
+    void Kill(Target target);
+    void Group(Target target, int groupId);
+    void Tag(Target target, int tagId);
+    void SetEnabled(Target target, bool enabled);
+
+    bool IsEmpty() const;
+    // Discards every recorded command
+    void Clear();
+
+    // Applies every recorded command in the order creations, groups and tags,
+    // enabling and disabling, component additions and removals per type in
+    // recorded order, kills, and clears the buffer
+    void Playback(Registry &registry);
+};
+
+template <typename TComponent>
+CommandBuffer::ComponentCommands<TComponent> &
+CommandBuffer::GetComponentCommands() {
+    const auto componentId = Component<TComponent>::GetId();
+    if (componentId >= static_cast<int>(componentCommands.size())) {
+        componentCommands.resize(componentId + 1);
+    }
+    if (!componentCommands[componentId]) {
+        componentCommands[componentId] =
+            std::make_unique<ComponentCommands<TComponent>>();
+    }
+    return static_cast<ComponentCommands<TComponent> &>(
+        *componentCommands[componentId]
+    );
+}
+
+template <typename TComponent, typename... TArgs>
+void CommandBuffer::AddComponent(Target target, TArgs &&...args) {
+    auto &componentCommands = GetComponentCommands<TComponent>();
+    componentCommands.commands.emplace_back(
+        target, TComponent(std::forward<TArgs>(args)...)
+    );
+    componentCommands.numAdditions++;
+}
+
+template <typename TComponent>
+void CommandBuffer::RemoveComponent(Target target) {
+    GetComponentCommands<TComponent>().commands.emplace_back(
+        target, std::nullopt
+    );
+}
+
+template <typename TComponent>
+void CommandBuffer::ComponentCommands<TComponent>::Playback(
+    Registry &registry,
+    const std::vector<Entity> &createdEntities
+) {
+    registry.Reserve<TComponent>(numAdditions);
+    for (auto &[target, value] : commands) {
+        const auto *entity = Resolve(registry, createdEntities, target);
+        if (!entity) {
+            continue;
+        }
+        if (value) {
+            registry.EmplaceComponent<TComponent>(*entity, std::move(*value));
+        } else if (registry.HasComponent<TComponent>(*entity)) {
+            registry.RemoveComponent<TComponent>(*entity);
+        }
+    }
+    Clear();
+}
+
+template <typename TComponent, typename... TArgs>
+void Registry::DeferAddComponent(Entity entity, TArgs &&...args) {
+    deferredCommands->AddComponent<TComponent>(
+        entity, std::forward<TArgs>(args)...
+    );
+}
+
+template <typename TComponent>
+void Registry::DeferRemoveComponent(Entity entity) {
+    deferredCommands->RemoveComponent<TComponent>(entity);
+}
+
+template <typename TFunc>
+void System::ParallelForChunks(int chunkSize, TFunc fn) {
+    const int count = entities.size();
+    if (threadPool == nullptr || count <= chunkSize) {
+        fn(0, count);
+        return;
+    }
+
+    const int numChunks = (count + chunkSize - 1) / chunkSize;
+    std::vector<CommandBuffer> commandsPerChunk(numChunks);
+    threadPool->ParallelFor(
+        count,
+        chunkSize,
+        [&](int chunk, int begin, int end) {
+            auto *previous = Registry::DeferTo(&commandsPerChunk[chunk]);
+            fn(begin, end);
+            Registry::DeferTo(previous);
+        }
+    );
+    // Every system entity belongs to the registry the system runs in
+    Registry &registry = *entities.front().GetRegistry();
+    for (auto &commands : commandsPerChunk) {
+        commands.Playback(registry);
+    }
+}
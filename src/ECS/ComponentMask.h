@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+// Fixed-width bit set used for component signatures. The bits live in 64-bit
+// words and every operation is a loop over a compile-time number of words, so
+// it unrolls into one or a few word (or SIMD) operations for any width. The
+// interface mirrors the parts of std::bitset the ECS uses.
+template <unsigned int N> class ComponentMask {
+private:
+    static constexpr unsigned int WORD_BITS = 64;
+    static constexpr unsigned int NUM_WORDS = (N + WORD_BITS - 1) / WORD_BITS;
+
+    uint64_t words[NUM_WORDS] = {};
+
+    static uint64_t Bit(unsigned int position) {
+        return uint64_t(1) << (position % WORD_BITS);
+    }
+
+public:
+    static constexpr unsigned int size() { return N; }
+
+    bool test(unsigned int position) const {
+        assert(position < N);
+        return (words[position / WORD_BITS] & Bit(position)) != 0;
+    }
+    ComponentMask &set(unsigned int position, bool value = true) {
+        assert(position < N);
+        if (value) {
+            words[position / WORD_BITS] |= Bit(position);
+        } else {
+            words[position / WORD_BITS] &= ~Bit(position);
+        }
+        return *this;
+    }
+    ComponentMask &reset(unsigned int position) { return set(position, false); }
+    ComponentMask &reset() {
+        for (unsigned int i = 0; i < NUM_WORDS; i++) {
+            words[i] = 0;
+        }
+        return *this;
+    }
+
+    bool any() const {
+        uint64_t combined = 0;
+        for (unsigned int i = 0; i < NUM_WORDS; i++) {
+            combined |= words[i];
+        }
+        return combined != 0;
+    }
+    bool none() const { return !any(); }
+
+    // True when every bit of this mask is also set in other
+    bool IsSubsetOf(const ComponentMask &other) const {
+        uint64_t missing = 0;
+        for (unsigned int i = 0; i < NUM_WORDS; i++) {
+            missing |= words[i] & ~other.words[i];
+        }
+        return missing == 0;
+    }
+
+    // Calls fn(position) for every set bit, lowest position first
+    template <typename TFunc> void ForEachSetBit(TFunc fn) const {
+        for (unsigned int i = 0; i < NUM_WORDS; i++) {
+            for (uint64_t word = words[i]; word != 0; word &= word - 1) {
+                fn(i * WORD_BITS + __builtin_ctzll(word));
+            }
+        }
+    }
+
+    ComponentMask &operator&=(const ComponentMask &other) {
+        for (unsigned int i = 0; i < NUM_WORDS; i++) {
+            words[i] &= other.words[i];
+        }
+        return *this;
+    }
+    ComponentMask &operator|=(const ComponentMask &other) {
+        for (unsigned int i = 0; i < NUM_WORDS; i++) {
+            words[i] |= other.words[i];
+        }
+        return *this;
+    }
+    ComponentMask &operator^=(const ComponentMask &other) {
+        for (unsigned int i = 0; i < NUM_WORDS; i++) {
+            words[i] ^= other.words[i];
+        }
+        return *this;
+    }
+    ComponentMask operator&(const ComponentMask &other) const {
+        return ComponentMask(*this) &= other;
+    }
+    ComponentMask operator|(const ComponentMask &other) const {
+        return ComponentMask(*this) |= other;
+    }
+    ComponentMask operator^(const ComponentMask &other) const {
+        return ComponentMask(*this) ^= other;
+    }
+
+    bool operator==(const ComponentMask &other) const {
+        uint64_t difference = 0;
+        for (unsigned int i = 0; i < NUM_WORDS; i++) {
+            difference |= words[i] ^ other.words[i];
+        }
+        return difference == 0;
+    }
+    bool operator!=(const ComponentMask &other) const {
+        return !(*this == other);
+    }
+
+    size_t Hash() const {
+        uint64_t hash = 0;
+        for (unsigned int i = 0; i < NUM_WORDS; i++) {
+            hash = (hash ^ words[i]) * 0x100000001b3ull;
+        }
+        return static_cast<size_t>(hash ^ (hash >> 32));
+    }
+};
+
+namespace std {
+template <unsigned int N> struct hash<ComponentMask<N>> {
+    size_t operator()(const ComponentMask<N> &mask) const {
+        return mask.Hash();
+    }
+};
+} // namespace std
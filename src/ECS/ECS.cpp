@@ -1,171 +1,989 @@
 #include "ECS.h"
 #include "../Logger.h"
+#include "CommandBuffer.h"
+#include "Prefab.h"
 #include <algorithm>
+#include <stdexcept>
 
-int IComponent::nextId = 0;
+std::atomic<int> IComponent::nextId(0);
+std::vector<Registry *> Registry::registries;
+std::unordered_map<std::string, int> Registry::tagIds;
+std::unordered_map<std::string, int> Registry::groupIds;
+std::mutex Registry::namesMutex;
+thread_local CommandBuffer *Registry::deferredCommands = nullptr;
 
-void Entity::Kill() { registry->KillEntity(*this); }
+void Entity::Kill() { GetRegistry()->KillEntity(*this); }
+bool Entity::IsAlive() const { return GetRegistry()->IsAlive(*this); }
+void Entity::SetEnabled(bool enabled) {
+    GetRegistry()->SetEntityEnabled(*this, enabled);
+}
+bool Entity::IsEnabled() const { return GetRegistry()->IsEntityEnabled(*this); }
 
-void Entity::Tag(const std::string &tag) { registry->TagEntity(*this, tag); }
+void Entity::Tag(const std::string &tag) {
+    GetRegistry()->TagEntity(*this, tag);
+}
+void Entity::Tag(int tagId) { GetRegistry()->TagEntity(*this, tagId); }
 bool Entity::HasTag(const std::string &tag) const {
-    return registry->EntityHasTag(*this, tag);
+    return GetRegistry()->EntityHasTag(*this, tag);
 }
 void Entity::Group(const std::string &group) {
-    registry->GroupEntity(*this, group);
+    GetRegistry()->GroupEntity(*this, group);
 }
+void Entity::Group(int groupId) { GetRegistry()->GroupEntity(*this, groupId); }
 bool Entity::BelongsToGroup(const std::string &group) const {
-    return registry->EntityBelongsToGroup(*this, group);
+    return GetRegistry()->EntityBelongsToGroup(*this, group);
 }
 
-void System::AddEntityToSystem(Entity entity) { entities.push_back(entity); }
+int *SparseIndex::AllocatePage(int page) {
+    if (page >= static_cast<int>(pages.size())) {
+        pages.resize(page + 1);
+    }
+    pages[page] = std::make_unique<int[]>(PAGE_SIZE);
+    std::fill_n(pages[page].get(), PAGE_SIZE, NONE);
+    return pages[page].get();
+}
 
-void System::RemoveEntityFromSystem(Entity entity) {
-    entities.erase(
-        std::remove_if(
-            entities.begin(),
-            entities.end(),
-            [&entity](Entity other) { return entity == other; }
-        ),
-        entities.end()
+int SparseIndex::Shrink(int idLimit, int page) {
+    const size_t usedPages = (idLimit + PAGE_SIZE - 1) / PAGE_SIZE;
+    if (pages.size() > usedPages) {
+        pages.resize(usedPages);
+    }
+    if (page < static_cast<int>(pages.size())) {
+        auto &slots = pages[page];
+        if (slots && std::all_of(
+                         slots.get(),
+                         slots.get() + PAGE_SIZE,
+                         [](int slot) { return slot == NONE; }
+                     )) {
+            slots.reset();
+        }
+        if (page + 1 < static_cast<int>(pages.size())) {
+            return page + 1;
+        }
+    }
+    while (!pages.empty() && !pages.back()) {
+        pages.pop_back();
+    }
+    pages.shrink_to_fit();
+    return -1;
+}
+
+Archetype::Archetype(
+    const Signature &signature,
+    const std::vector<ComponentInfo> &componentInfos
+)
+: signature(signature),
+  columnOffsets(MAX_COMPONENTS, 0) {
+    size_t rowSize = sizeof(int);
+    size_t padding = 0;
+    signature.ForEachSetBit([&](int id) {
+        componentIds.push_back(id);
+        columns.push_back(componentInfos[id]);
+        rowSize += componentInfos[id].size;
+        padding += componentInfos[id].alignment - 1;
+    });
+    chunkCapacity = std::max<size_t>(1, (CHUNK_SIZE - padding) / rowSize);
+
+    // Entity IDs form the first column, component columns follow
+    size_t offset = chunkCapacity * sizeof(int);
+    for (unsigned int column = 0; column < columns.size(); column++) {
+        const size_t alignment = columns[column].alignment;
+        offset = (offset + alignment - 1) / alignment * alignment;
+        columnOffsets[componentIds[column]] = offset;
+        offset += chunkCapacity * columns[column].size;
+    }
+}
+
+Archetype::~Archetype() {
+    for (unsigned int row = 0; row < size; row++) {
+        DestroyRow(row);
+    }
+}
+
+unsigned int Archetype::ColumnOf(int componentId) const {
+    const auto column =
+        std::lower_bound(componentIds.begin(), componentIds.end(), componentId);
+    return column - componentIds.begin();
+}
+
+unsigned int Archetype::AllocateRow(int entityId) {
+    const unsigned int row = size;
+    if (row / chunkCapacity >= chunks.size()) {
+        chunks.push_back(std::make_unique<Chunk>());
+    }
+    GetEntityIds(row / chunkCapacity)[row % chunkCapacity] = entityId;
+    size += 1;
+    return row;
+}
+
+void Archetype::DestroyRow(unsigned int row) {
+    for (unsigned int column = 0; column < columns.size(); column++) {
+        columns[column].destroy(GetComponent(row, componentIds[column]));
+    }
+}
+
+int Archetype::FillRow(unsigned int row) {
+    const unsigned int lastRow = size - 1;
+    size -= 1;
+    if (row == lastRow) {
+        return -1;
+    }
+
+    for (unsigned int column = 0; column < columns.size(); column++) {
+        const int componentId = componentIds[column];
+        void *last = GetComponent(lastRow, componentId);
+        columns[column].moveConstruct(GetComponent(row, componentId), last);
+        columns[column].destroy(last);
+    }
+    const int movedEntityId =
+        GetEntityIds(lastRow / chunkCapacity)[lastRow % chunkCapacity];
+    GetEntityIds(row / chunkCapacity)[row % chunkCapacity] = movedEntityId;
+    return movedEntityId;
+}
+
+void Archetype::Clear() {
+    for (unsigned int row = 0; row < size; row++) {
+        DestroyRow(row);
+    }
+    size = 0;
+}
+
+void Archetype::Shrink() {
+    chunks.resize(GetChunkCount());
+    chunks.shrink_to_fit();
+}
+
+int ArchetypeStorage::GetOrCreateArchetype(const Signature &signature) {
+    const auto existing = archetypeIndices.find(signature);
+    if (existing != archetypeIndices.end()) {
+        return existing->second;
+    }
+    archetypes.push_back(std::make_unique<Archetype>(signature, componentInfos)
     );
+    const int index = archetypes.size() - 1;
+    archetypeIndices.emplace(signature, index);
+    return index;
+}
+
+void ArchetypeStorage::MoveEntity(int entityId, const Signature &signature) {
+    const EntityLocation from = locations[entityId];
+    EntityLocation to;
+
+    if (signature.any()) {
+        to.archetype = GetOrCreateArchetype(signature);
+        to.row = archetypes[to.archetype]->AllocateRow(entityId);
+    }
+
+    if (from.archetype != -1) {
+        auto &source = *archetypes[from.archetype];
+        if (to.archetype != -1) {
+            auto &destination = *archetypes[to.archetype];
+            for (const int componentId : source.GetComponentIds()) {
+                if (signature.test(componentId)) {
+                    componentInfos[componentId].moveConstruct(
+                        destination.GetComponent(to.row, componentId),
+                        source.GetComponent(from.row, componentId)
+                    );
+                }
+            }
+        }
+        source.DestroyRow(from.row);
+        const int movedEntityId = source.FillRow(from.row);
+        if (movedEntityId != -1) {
+            locations[movedEntityId].row = from.row;
+        }
+    }
+
+    locations[entityId] = to;
+}
+
+void ArchetypeStorage::AllocateRows(
+    const Signature &signature,
+    const std::vector<Entity> &entities
+) {
+    if (signature.none() || entities.empty()) {
+        return;
+    }
+    const int index = GetOrCreateArchetype(signature);
+    auto &archetype = *archetypes[index];
+    int maxEntityId = 0;
+    for (const auto &entity : entities) {
+        maxEntityId = std::max(maxEntityId, static_cast<int>(entity.GetId()));
+    }
+    if (maxEntityId >= static_cast<int>(locations.size())) {
+        locations.resize(maxEntityId + 1);
+    }
+    for (const auto &entity : entities) {
+        const int entityId = entity.GetId();
+        locations[entityId] = {index, archetype.AllocateRow(entityId)};
+    }
+}
+
+void ArchetypeStorage::Remove(int entityId, int componentId) {
+    const auto &location = locations[entityId];
+    Signature signature = archetypes[location.archetype]->GetSignature();
+    signature.reset(componentId);
+    MoveEntity(entityId, signature);
+}
+
+void ArchetypeStorage::RemoveEntity(int entityId) {
+    if (entityId >= static_cast<int>(locations.size()) ||
+        locations[entityId].archetype == -1) {
+        return;
+    }
+    MoveEntity(entityId, Signature());
+}
+
+void ArchetypeStorage::Clear() {
+    for (auto &archetype : archetypes) {
+        archetype->Clear();
+    }
+    std::fill(locations.begin(), locations.end(), EntityLocation());
+}
+
+int ArchetypeStorage::Shrink(int idLimit, int cursor) {
+    if (cursor == 0) {
+        if (static_cast<int>(locations.size()) > idLimit) {
+            locations.resize(idLimit);
+        }
+        ReleaseSpareCapacity(locations);
+    } else if (cursor <= static_cast<int>(archetypes.size())) {
+        archetypes[cursor - 1]->Shrink();
+    }
+    return cursor < static_cast<int>(archetypes.size()) ? cursor + 1 : -1;
+}
+
+System::System() { ExcludeComponent<DisabledComponent>(); }
+
+void System::IncludeDisabled() {
+    excludedSignature.reset(Component<DisabledComponent>::GetId());
+}
+
+void System::AddEntityToSystem(Entity entity) {
+    if (entityIndices.Contains(entity.GetId())) {
+        return;
+    }
+    entityIndices.Set(entity.GetId(), entities.size());
+    entities.push_back(entity);
+}
+
+void System::RemoveEntityFromSystem(Entity entity) {
+    const int index = entityIndices.Get(entity.GetId());
+    if (index == SparseIndex::NONE) {
+        return;
+    }
+    const Entity last = entities.back();
+    entities[index] = last;
+    entityIndices.Set(last.GetId(), index);
+    entities.pop_back();
+    entityIndices.Reset(entity.GetId());
+    OnEntityRemoved(entity);
+}
+
+void System::RemoveEntities(const std::vector<Entity> &entitiesToRemove) {
+    // Swap-and-pop is O(1) per entity, but once a large share of the system
+    // goes away a single compacting pass over the list is cheaper
+    if (entitiesToRemove.size() < entities.size() / 4) {
+        for (const auto &entity : entitiesToRemove) {
+            RemoveEntityFromSystem(entity);
+        }
+        return;
+    }
+
+    for (const auto &entity : entitiesToRemove) {
+        if (entityIndices.Contains(entity.GetId())) {
+            entityIndices.Reset(entity.GetId());
+            OnEntityRemoved(entity);
+        }
+    }
+    unsigned int kept = 0;
+    for (const auto &entity : entities) {
+        if (entityIndices.Contains(entity.GetId())) {
+            entityIndices.Set(entity.GetId(), kept);
+            entities[kept++] = entity;
+        }
+    }
+    entities.erase(entities.begin() + kept, entities.end());
 }
 
 const std::vector<Entity> &System::GetSystemEntities() const {
     return entities;
 }
 
+void System::Clear() {
+    for (const auto &entity : entities) {
+        entityIndices.Reset(entity.GetId());
+        OnEntityRemoved(entity);
+    }
+    entities.clear();
+}
+
+int System::Shrink(int idLimit, int cursor) {
+    if (cursor == 0) {
+        ReleaseSpareCapacity(entities);
+        return 1;
+    }
+    const int page = entityIndices.Shrink(idLimit, cursor - 1);
+    return page == -1 ? -1 : page + 1;
+}
+
 const Signature &System::GetComponentSignature() const {
     return componentSignature;
 }
 
-Entity Registry::CreateEntity() {
-    int entityId;
+uint32_t System::BeginRun(Registry &registry) {
+    const uint32_t previousRunTick = lastRunTick;
+    lastRunTick = registry.AdvanceChangeTick();
+    return previousRunTick;
+}
 
-    if (freeIds.empty()) {
-        entityId = numEntities++;
-        if (entityId >= static_cast<int>(entityComponentSignatures.size())) {
-            entityComponentSignatures.resize(entityId + 1);
-        }
+bool System::ConflictsWith(const System &other) const {
+    const auto access = readSignature | writeSignature;
+    const auto otherAccess = other.readSignature | other.writeSignature;
+    if (access.none() || otherAccess.none()) {
+        return true;
+    }
+    return (writeSignature & otherAccess).any() ||
+           (other.writeSignature & access).any();
+}
+
+Registry::Registry(ComponentStorage storage) {
+    const auto freeSlot =
+        std::find(registries.begin(), registries.end(), nullptr);
+    registryIndex = freeSlot - registries.begin();
+    if (freeSlot == registries.end()) {
+        registries.push_back(this);
     } else {
-        entityId = freeIds.front();
-        freeIds.pop_front();
+        *freeSlot = this;
+    }
+
+    if (storage == ComponentStorage::Archetypes) {
+        archetypes = std::make_unique<ArchetypeStorage>();
     }
+}
 
-    Entity entity(entityId);
-    entity.registry = this;
-    entitiesToBeAdded.insert(entity);
+Registry::~Registry() { registries[registryIndex] = nullptr; }
 
+void Registry::ResizeEntityStorage(int size) {
+    if (size <= static_cast<int>(entityComponentSignatures.size())) {
+        return;
+    }
+    // Generations outlive compaction, see CompactEntityIds
+    if (size > static_cast<int>(entityGenerations.size())) {
+        entityGenerations.resize(size);
+    }
+    entityComponentSignatures.resize(size);
+    entitySystemSignatures.resize(size);
+    isQueuedForUpdate.resize(size);
+    isQueuedForKill.resize(size);
+    entityTagMasks.resize(size);
+    entityGroupMasks.resize(size);
+}
+
+int Registry::CountFreeIds() const {
+    const bool isSortingIds = compactionStep == 0 || compactionStep == 1;
+    return freeIds.size() + (isSortingIds ? compactionFreeIds.size() : 0);
+}
+
+int Registry::AllocateEntityId() {
+    if (!freeIds.empty()) {
+        const int entityId = freeIds.front();
+        freeIds.pop_front();
+        return entityId;
+    }
+    // While a compaction pass holds the free IDs it gives up the ones it has
+    // not marked yet, and then the lowest ones it has sorted
+    if ((compactionStep == 0 || compactionStep == 1) &&
+        !compactionFreeIds.empty()) {
+        const int entityId = compactionFreeIds.front();
+        compactionFreeIds.pop_front();
+        return entityId;
+    }
+    // A larger index would spill into the generation bits and alias a live
+    // entity
+    if (static_cast<uint32_t>(numEntities) > ENTITY_INDEX_MASK) {
+        Logger::Err("Entity limit reached");
+        throw std::length_error("Entity limit reached");
+    }
+    ResizeEntityStorage(numEntities + 1);
+    return numEntities++;
+}
+
+Entity Registry::CreateEntity() {
+    assert(
+        deferredCommands == nullptr &&
+        "Create entities inside parallel loops through GetDeferredCommands()"
+    );
+    const int entityId = AllocateEntityId();
     Logger::Log("Entity created with id = " + std::to_string(entityId));
-    return entity;
+    return GetEntity(entityId);
 }
 
-void Registry::KillEntity(Entity entity) { entitiesToBeKilled.insert(entity); }
+std::vector<Entity> Registry::Instantiate(const Prefab &prefab, int count) {
+    assert(
+        deferredCommands == nullptr &&
+        "Instantiate inside parallel loops through GetDeferredCommands()"
+    );
+    // Checked up front so a failed batch leaves no half-built entities
+    const int newIds = count - CountFreeIds();
+    if (newIds > 0 &&
+        static_cast<uint32_t>(numEntities + newIds) > ENTITY_INDEX_MASK + 1) {
+        Logger::Err("Entity limit reached");
+        throw std::length_error("Entity limit reached");
+    }
+    std::vector<Entity> entities;
+    entities.reserve(count);
+    ResizeEntityStorage(numEntities + newIds);
+    for (int i = 0; i < count; i++) {
+        const int entityId = AllocateEntityId();
+        entityComponentSignatures[entityId] = prefab.signature;
+        entities.push_back(GetEntity(entityId));
+        QueueForUpdate(entities.back());
+    }
 
-void Registry::AddEntityToSystems(Entity entity) {
-    const auto entityId = entity.GetId();
-    const auto &entityComponentSignature = entityComponentSignatures[entityId];
+    if (archetypes) {
+        for (const auto &component : prefab.components) {
+            if (component) {
+                component->RegisterComponent(*archetypes);
+            }
+        }
+        archetypes->AllocateRows(prefab.archetypeSignature, entities);
+    }
+    for (const auto &component : prefab.components) {
+        if (component) {
+            component->Instantiate(*this, entities);
+        }
+    }
+    for (const int groupId : prefab.groupIds) {
+        for (const auto &entity : entities) {
+            GroupEntity(entity, groupId);
+        }
+    }
+
+    Logger::Log(std::to_string(count) + " entities instantiated from prefab");
+    return entities;
+}
+
+CommandBuffer &Registry::CreateCommandBuffer() {
+    commandBuffers.push_back(std::make_unique<CommandBuffer>());
+    return *commandBuffers.back();
+}
+
+void Registry::KillEntity(Entity entity) {
+    if (deferredCommands != nullptr) {
+        deferredCommands->Kill(entity);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(entitiesToBeKilledMutex);
+    if (IsAlive(entity) && !isQueuedForKill[entity.GetId()]) {
+        isQueuedForKill[entity.GetId()] = true;
+        entitiesToBeKilled.push_back(entity);
+    }
+}
+
+void Registry::SetEntityEnabled(Entity entity, bool enabled) {
+    if (deferredCommands != nullptr) {
+        deferredCommands->SetEnabled(entity, enabled);
+        return;
+    }
+    if (IsEntityEnabled(entity) == enabled) {
+        return;
+    }
+    entityComponentSignatures[entity.GetId()].set(
+        Component<DisabledComponent>::GetId(), !enabled
+    );
+    QueueForUpdate(entity);
+}
+
+CommandBuffer *Registry::DeferTo(CommandBuffer *buffer) {
+    auto *previous = deferredCommands;
+    deferredCommands = buffer;
+    return previous;
+}
+
+void Registry::SetThreadPool(ThreadPool *threadPool) {
+    this->threadPool = threadPool;
     for (auto &system : systems) {
-        const auto &systemComponentSignature =
-            system.second->GetComponentSignature();
-        bool isInterested =
-            (entityComponentSignature & systemComponentSignature) ==
-            systemComponentSignature;
-        if (isInterested) {
-            system.second->AddEntityToSystem(entity);
+        system.second->SetThreadPool(threadPool);
+    }
+}
+
+void Registry::RegisterSystem(System *system) {
+    // Excluded components change membership just like required ones
+    const auto components =
+        system->GetComponentSignature() | system->GetExcludedSignature();
+    components.ForEachSetBit([&](int id) {
+        if (id >= static_cast<int>(systemsPerComponent.size())) {
+            systemsPerComponent.resize(id + 1);
         }
+        systemsPerComponent[id].push_back(system);
+    });
+}
+
+void Registry::UnregisterSystem(System *system) {
+    for (auto &interested : systemsPerComponent) {
+        interested.erase(
+            std::remove(interested.begin(), interested.end(), system),
+            interested.end()
+        );
     }
 }
 
-void Registry::RemoveEntityFromSystems(Entity entity) {
+void Registry::CollectAffectedSystems(const Signature &changedComponents) {
+    affectedSystems.clear();
+    changedComponents.ForEachSetBit([&](int id) {
+        if (id < static_cast<int>(systemsPerComponent.size())) {
+            affectedSystems.insert(
+                affectedSystems.end(),
+                systemsPerComponent[id].begin(),
+                systemsPerComponent[id].end()
+            );
+        }
+    });
+    std::sort(affectedSystems.begin(), affectedSystems.end());
+    affectedSystems.erase(
+        std::unique(affectedSystems.begin(), affectedSystems.end()),
+        affectedSystems.end()
+    );
+}
+
+void Registry::UpdateEntityInSystems(Entity entity) {
     const auto entityId = entity.GetId();
-    const auto &entityComponentSignature = entityComponentSignatures[entityId];
-    for (auto &system : systems) {
-        const auto &systemComponentSignature =
-            system.second->GetComponentSignature();
-        bool isInterested =
-            (entityComponentSignature & systemComponentSignature) ==
-            systemComponentSignature;
-        if (isInterested) {
-            system.second->RemoveEntityFromSystem(entity);
+    const auto &signature = entityComponentSignatures[entityId];
+    auto &previousSignature = entitySystemSignatures[entityId];
+    if (signature == previousSignature) {
+        return;
+    }
+
+    CollectAffectedSystems(signature ^ previousSignature);
+    for (System *system : affectedSystems) {
+        const bool wasInterested = system->IsInterestedIn(previousSignature);
+        const bool isInterested = system->IsInterestedIn(signature);
+        if (isInterested && !wasInterested) {
+            system->AddEntityToSystem(entity);
+        } else if (wasInterested && !isInterested) {
+            system->RemoveEntityFromSystem(entity);
         }
     }
+    previousSignature = signature;
 }
 
 void Registry::Update() {
-    for (auto &entity : entitiesToBeAdded) {
-        AddEntityToSystems(entity);
+    for (auto &commandBuffer : commandBuffers) {
+        commandBuffer->Playback(*this);
     }
-    entitiesToBeAdded.clear();
 
-    for (auto &entity : entitiesToBeKilled) {
+    for (auto &entity : entitiesToBeUpdated) {
+        isQueuedForUpdate[entity.GetId()] = false;
+        UpdateEntityInSystems(entity);
+    }
+    entitiesToBeUpdated.clear();
+
+    DestroyEntities(entitiesToBeKilled);
+    entitiesToBeKilled.clear();
+}
+
+void Registry::DestroyEntities(const std::vector<Entity> &entities) {
+    for (auto &system : systems) {
+        system.second->RemoveEntities(entities);
+    }
+
+    for (auto &entity : entities) {
         const int id = entity.GetId();
-        RemoveEntityFromSystems(entity);
-        entityComponentSignatures[id].reset();
+        auto &signature = entityComponentSignatures[id];
 
-        for (auto pool : componentPools) {
-            if (pool) {
-                pool->RemoveEntity(entity.GetId());
-            }
+        if (archetypes) {
+            archetypes->RemoveEntity(id);
+        } else {
+            // Tag components have no pool
+            signature.ForEachSetBit([&](int componentId) {
+                if (IPool *pool = FindPool(componentId)) {
+                    pool->RemoveEntity(id);
+                }
+            });
         }
+        signature.reset();
+        entitySystemSignatures[id].reset();
+        isQueuedForKill[id] = false;
 
-        freeIds.push_back(id);
         RemoveEntityTag(entity);
         RemoveEntityGroup(entity);
+        entityGenerations[id] =
+            (entityGenerations[id] + 1) & ENTITY_GENERATION_MASK;
+        freeIds.push_back(id);
     }
+    killsSinceCompaction += entities.size();
+}
+
+void Registry::Clear() {
+    for (auto &commandBuffer : commandBuffers) {
+        commandBuffer->Clear();
+    }
+    entitiesToBeUpdated.clear();
     entitiesToBeKilled.clear();
+
+    if (archetypes) {
+        archetypes->Clear();
+    }
+    for (auto &pool : componentPools) {
+        if (pool) {
+            pool->Clear();
+        }
+    }
+    for (auto &system : systems) {
+        system.second->Clear();
+    }
+    for (auto &group : groups) {
+        for (const auto &entity : group.entities) {
+            group.positions.Reset(entity.GetId());
+        }
+        group.entities.clear();
+    }
+    std::fill(taggedEntityIds.begin(), taggedEntityIds.end(), -1);
+
+    // IDs are handed out from 0 again, the new generations keep old handles
+    // stale
+    for (int id = 0; id < numEntities; id++) {
+        entityGenerations[id] =
+            (entityGenerations[id] + 1) & ENTITY_GENERATION_MASK;
+    }
+    std::fill(
+        entityComponentSignatures.begin(),
+        entityComponentSignatures.end(),
+        Signature()
+    );
+    std::fill(
+        entitySystemSignatures.begin(),
+        entitySystemSignatures.end(),
+        Signature()
+    );
+    std::fill(isQueuedForUpdate.begin(), isQueuedForUpdate.end(), false);
+    std::fill(isQueuedForKill.begin(), isQueuedForKill.end(), false);
+    std::fill(entityTagMasks.begin(), entityTagMasks.end(), 0);
+    std::fill(entityGroupMasks.begin(), entityGroupMasks.end(), 0);
+    freeIds.clear();
+    numEntities = 0;
+    compactionStep = -1;
+    compactionFreeIds.clear();
+    compactionIsFree.clear();
+    killsSinceCompaction = 0;
+}
+
+// Bucketing is much cheaper than sorting the free list. The IDs are moved
+// into a bitmap first, from the back so AllocateEntityId can keep taking the
+// oldest ones from the front, then collected in order range by range.
+int Registry::MarkFreeIds(int cursor) {
+    for (int i = 0; i < COMPACTION_ID_RANGE && !compactionFreeIds.empty();
+         i++) {
+        compactionIsFree[compactionFreeIds.back()] = true;
+        compactionFreeIds.pop_back();
+    }
+    return compactionFreeIds.empty() ? -1 : cursor + 1;
+}
+
+int Registry::SortFreeIds(int cursor) {
+    const int end = std::min(
+        cursor + COMPACTION_ID_RANGE,
+        static_cast<int>(compactionIsFree.size())
+    );
+    for (int id = cursor; id < end; id++) {
+        if (compactionIsFree[id]) {
+            compactionFreeIds.push_back(id);
+        }
+    }
+    if (end < static_cast<int>(compactionIsFree.size())) {
+        return end;
+    }
+    compactionIsFree.clear();
+    compactionIsFree.shrink_to_fit();
+    return -1;
+}
+
+// Generations are kept, so handles to trimmed IDs stay stale once the IDs
+// are handed out again
+int Registry::TrimEntityIds(int cursor) {
+    // The per-ID vectors are never smaller than numEntities, so this only
+    // truncates them
+    const auto shrink = [this](auto &ids) {
+        ids.resize(numEntities);
+        ReleaseSpareCapacity(ids);
+    };
+    switch (cursor) {
+    case 0:
+        // IDs created after every free ID was taken lie above the sorted
+        // ones, and nothing is trimmed then
+        while (!compactionFreeIds.empty() &&
+               compactionFreeIds.back() == numEntities - 1) {
+            compactionFreeIds.pop_back();
+            numEntities--;
+        }
+        // IDs freed during the pass are reused after the sorted ones
+        compactionFreeIds.insert(
+            compactionFreeIds.end(), freeIds.begin(), freeIds.end()
+        );
+        freeIds.swap(compactionFreeIds);
+        compactionFreeIds.clear();
+        compactionFreeIds.shrink_to_fit();
+        return 1;
+    case 1:
+        ReleaseSpareCapacity(entitiesToBeUpdated);
+        return 2;
+    case 2:
+        ReleaseSpareCapacity(entitiesToBeKilled);
+        return 3;
+    case 3:
+        // First of the per-ID vectors, as ResizeEntityStorage goes by its
+        // size
+        shrink(entityComponentSignatures);
+        return 4;
+    case 4:
+        shrink(entitySystemSignatures);
+        return 5;
+    case 5:
+        shrink(isQueuedForUpdate);
+        shrink(isQueuedForKill);
+        return 6;
+    case 6:
+        shrink(entityTagMasks);
+        return 7;
+    default:
+        shrink(entityGroupMasks);
+        return -1;
+    }
+}
+
+int Registry::RunCompactionStep(int step, int cursor) {
+    switch (step) {
+    case 0:
+        return MarkFreeIds(cursor);
+    case 1:
+        return SortFreeIds(cursor);
+    case 2:
+        return TrimEntityIds(cursor);
+    case 3:
+        return archetypes ? archetypes->Shrink(numEntities, cursor) : -1;
+    }
+
+    // Then one step per pool, per system and per group
+    step -= 4;
+    if (step < static_cast<int>(componentPools.size())) {
+        IPool *pool = componentPools[step].get();
+        return pool ? pool->Shrink(numEntities, cursor) : -1;
+    }
+    step -= componentPools.size();
+    if (step < static_cast<int>(systems.size())) {
+        auto &system = std::next(systems.begin(), step)->second;
+        return system->Shrink(numEntities, cursor);
+    }
+    step -= systems.size();
+    auto &group = groups[step];
+    if (cursor == 0) {
+        ReleaseSpareCapacity(group.entities);
+        return 1;
+    }
+    const int page = group.positions.Shrink(numEntities, cursor - 1);
+    return page == -1 ? -1 : page + 1;
+}
+
+void Registry::Compact(std::chrono::microseconds budget) {
+    if (compactionStep < 0) {
+        if (killsSinceCompaction < COMPACTION_MIN_KILLS) {
+            return;
+        }
+        killsSinceCompaction = 0;
+        compactionStep = 0;
+        compactionCursor = 0;
+        compactionFreeIds.swap(freeIds);
+        compactionIsFree.assign(numEntities, false);
+    }
+
+    // The entity IDs go first so the later steps see the trimmed ID space
+    const auto start = std::chrono::steady_clock::now();
+    while (compactionStep >= 0) {
+        compactionCursor = RunCompactionStep(compactionStep, compactionCursor);
+        if (compactionCursor == -1) {
+            compactionCursor = 0;
+            compactionStep++;
+            const int numSteps =
+                4 + componentPools.size() + systems.size() + groups.size();
+            if (compactionStep == numSteps) {
+                compactionStep = -1;
+            }
+        }
+        if (std::chrono::steady_clock::now() - start >= budget) {
+            break;
+        }
+    }
+}
+
+int Registry::InternName(
+    std::unordered_map<std::string, int> &ids,
+    const std::string &name,
+    int limit
+) {
+    std::lock_guard<std::mutex> lock(namesMutex);
+    const auto existing = ids.find(name);
+    if (existing != ids.end()) {
+        return existing->second;
+    }
+    if (static_cast<int>(ids.size()) >= limit) {
+        Logger::Err("Too many tag or group names, cannot add " + name);
+        throw std::length_error("Too many tag or group names");
+    }
+    const int id = ids.size();
+    ids.emplace(name, id);
+    return id;
+}
+int Registry::FindName(
+    const std::unordered_map<std::string, int> &ids,
+    const std::string &name
+) {
+    std::lock_guard<std::mutex> lock(namesMutex);
+    const auto existing = ids.find(name);
+    return existing != ids.end() ? existing->second : -1;
+}
+int Registry::GetTagId(const std::string &tag) {
+    return InternName(tagIds, tag, MAX_TAGS);
+}
+int Registry::GetGroupId(const std::string &group) {
+    return InternName(groupIds, group, MAX_GROUPS);
 }
 
 void Registry::TagEntity(Entity entity, const std::string &tag) {
-    entityPerTag.emplace(tag, entity);
-    tagPerEntity.emplace(entity.GetId(), tag);
+    TagEntity(entity, GetTagId(tag));
 }
-bool Registry::EntityHasTag(Entity entity, const std::string &tag) const {
-    if (tagPerEntity.find(entity.GetId()) == tagPerEntity.end()) {
-        return false;
+void Registry::TagEntity(Entity entity, int tagId) {
+    if (deferredCommands != nullptr) {
+        deferredCommands->Tag(entity, tagId);
+        return;
     }
-    return entityPerTag.find(tag)->second == entity;
+    if (tagId < 0 || tagId >= MAX_TAGS) {
+        throw std::out_of_range("Invalid tag ID");
+    }
+    if (tagId >= static_cast<int>(taggedEntityIds.size())) {
+        taggedEntityIds.resize(tagId + 1, -1);
+    }
+    const int previousEntityId = taggedEntityIds[tagId];
+    if (previousEntityId != -1) {
+        entityTagMasks[previousEntityId] &= ~(uint64_t(1) << tagId);
+    }
+    taggedEntityIds[tagId] = entity.GetId();
+    entityTagMasks[entity.GetId()] |= uint64_t(1) << tagId;
+}
+bool Registry::EntityHasTag(Entity entity, const std::string &tag) const {
+    const int tagId = FindName(tagIds, tag);
+    return tagId != -1 && EntityHasTag(entity, tagId);
+}
+bool Registry::TagExists(const std::string &tag) const {
+    return TagExists(FindName(tagIds, tag));
+}
+bool Registry::TagExists(int tagId) const {
+    return tagId >= 0 && tagId < static_cast<int>(taggedEntityIds.size()) &&
+           taggedEntityIds[tagId] != -1;
 }
 Entity Registry::GetEntityByTag(const std::string &tag) const {
-    return entityPerTag.at(tag);
+    return GetEntityByTag(FindName(tagIds, tag));
+}
+Entity Registry::GetEntityByTag(int tagId) const {
+    if (!TagExists(tagId)) {
+        throw std::out_of_range("No entity has the tag");
+    }
+    return GetEntity(taggedEntityIds[tagId]);
 }
 void Registry::RemoveEntityTag(Entity entity) {
-    const auto taggedEntity = tagPerEntity.find(entity.GetId());
-    if (taggedEntity != tagPerEntity.end()) {
-        const auto tag = taggedEntity->second;
-        entityPerTag.erase(tag);
-        tagPerEntity.erase(taggedEntity);
+    uint64_t &tags = entityTagMasks[entity.GetId()];
+    for (; tags != 0; tags &= tags - 1) {
+        taggedEntityIds[__builtin_ctzll(tags)] = -1;
     }
 }
 
 void Registry::GroupEntity(Entity entity, const std::string &group) {
-    entitiesPerGroup.emplace(group, std::set<Entity>());
-    entitiesPerGroup[group].emplace(entity);
-    groupPerEntity.emplace(entity.GetId(), group);
+    GroupEntity(entity, GetGroupId(group));
+}
+void Registry::GroupEntity(Entity entity, int groupId) {
+    if (deferredCommands != nullptr) {
+        deferredCommands->Group(entity, groupId);
+        return;
+    }
+    if (groupId < 0 || groupId >= MAX_GROUPS) {
+        throw std::out_of_range("Invalid group ID");
+    }
+    if (EntityBelongsToGroup(entity, groupId)) {
+        return;
+    }
+    if (groupId >= static_cast<int>(groups.size())) {
+        groups.resize(groupId + 1);
+    }
+    auto &group = groups[groupId];
+    group.positions.Set(entity.GetId(), group.entities.size());
+    group.entities.push_back(entity);
+    entityGroupMasks[entity.GetId()] |= uint64_t(1) << groupId;
 }
 bool Registry::EntityBelongsToGroup(
     Entity entity, const std::string &group
 ) const {
-    if (groupPerEntity.find(entity.GetId()) == groupPerEntity.end()) {
-        return false;
-    }
-    return groupPerEntity.find(entity.GetId())->second == group;
+    const int groupId = FindName(groupIds, group);
+    return groupId != -1 && EntityBelongsToGroup(entity, groupId);
 }
-std::vector<Entity>
+const std::vector<Entity> &
 Registry::GetEntitiesByGroup(const std::string &group) const {
-    const auto &entities = entitiesPerGroup.at(group);
-    return std::vector<Entity>(entities.begin(), entities.end());
+    return GetEntitiesByGroup(FindName(groupIds, group));
 }
-void Registry::RemoveEntityGroup(Entity entity) {
-    const auto &groupEntry = groupPerEntity.find(entity.GetId());
-    if (groupEntry == groupPerEntity.end()) {
+const std::vector<Entity> &Registry::GetEntitiesByGroup(int groupId) const {
+    static const std::vector<Entity> noEntities;
+    if (groupId < 0 || groupId >= static_cast<int>(groups.size())) {
+        return noEntities;
+    }
+    return groups[groupId].entities;
+}
+void Registry::ClearGroup(const std::string &group) {
+    ClearGroup(FindName(groupIds, group));
+}
+void Registry::ClearGroup(int groupId) {
+    if (groupId < 0 || groupId >= static_cast<int>(groups.size()) ||
+        groups[groupId].entities.empty()) {
         return;
     }
-    const auto group = entitiesPerGroup.find(groupEntry->second);
-    if (group != entitiesPerGroup.end()) {
-        const auto entityInGroup = group->second.find(entity);
-        if (entityInGroup != group->second.end()) {
-            group->second.erase(entityInGroup);
-        }
+    // Queued updates and kills of the members would otherwise apply to the
+    // entities that reuse their IDs
+    const auto isMember = [&](const Entity &entity) {
+        return IsAlive(entity) && EntityBelongsToGroup(entity, groupId);
+    };
+    entitiesToBeUpdated.erase(
+        std::remove_if(
+            entitiesToBeUpdated.begin(),
+            entitiesToBeUpdated.end(),
+            [&](const Entity &entity) {
+                if (!isMember(entity)) {
+                    return false;
+                }
+                isQueuedForUpdate[entity.GetId()] = false;
+                return true;
+            }
+        ),
+        entitiesToBeUpdated.end()
+    );
+    entitiesToBeKilled.erase(
+        std::remove_if(
+            entitiesToBeKilled.begin(), entitiesToBeKilled.end(), isMember
+        ),
+        entitiesToBeKilled.end()
+    );
+
+    // Destroying the members edits the group, so work on a copy
+    const std::vector<Entity> members = groups[groupId].entities;
+    DestroyEntities(members);
+}
+void Registry::RemoveEntityGroup(Entity entity) {
+    const int entityId = entity.GetId();
+    uint64_t &memberships = entityGroupMasks[entityId];
+    for (; memberships != 0; memberships &= memberships - 1) {
+        auto &group = groups[__builtin_ctzll(memberships)];
+        const int position = group.positions.Get(entityId);
+        const Entity last = group.entities.back();
+        group.entities[position] = last;
+        group.positions.Set(last.GetId(), position);
+        group.entities.pop_back();
+        group.positions.Reset(entityId);
     }
-    groupPerEntity.erase(groupEntry);
 }
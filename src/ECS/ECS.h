@@ -1,267 +1,1264 @@
 #pragma once
 
+#include "../Components/ComponentTypes.h"
 #include "../Logger.h"
-#include <bitset>
+#include "ComponentMask.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
 #include <deque>
 #include <memory>
-#include <set>
+#include <mutex>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
 #include <typeindex>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
-const unsigned int MAX_COMPONENTS = 32;
+// Signature width, may be raised at build time (e.g. -DECS_MAX_COMPONENTS=128)
+#ifndef ECS_MAX_COMPONENTS
+#define ECS_MAX_COMPONENTS 64
+#endif
 
-typedef std::bitset<MAX_COMPONENTS> Signature;
+const unsigned int MAX_COMPONENTS = ECS_MAX_COMPONENTS;
+
+typedef ComponentMask<MAX_COMPONENTS> Signature;
+
+static_assert(
+    ComponentTypes::size <= MAX_COMPONENTS,
+    "ECS_MAX_COMPONENTS is too small for the registered component types"
+);
+
+// Empty components are markers: they only set their signature bit and get no
+// pool, so they can be tested but never fetched.
+template <typename T>
+inline constexpr bool IS_TAG_COMPONENT = std::is_empty_v<T>;
+
+// Marks disabled entities, see Registry::SetEntityEnabled
+struct DisabledComponent {};
 
 struct IComponent {
 protected:
-    static int nextId;
+    static std::atomic<int> nextId;
+
+    // Signatures, pools and systems are indexed by component ID, so an ID
+    // past the signature width must never be handed out
+    static int AssignRuntimeId() {
+        const int id = ComponentTypes::size + nextId++;
+        if (id >= static_cast<int>(MAX_COMPONENTS)) {
+            throw std::length_error(
+                "Too many component types, raise ECS_MAX_COMPONENTS"
+            );
+        }
+        return id;
+    }
 };
 
+// Components in ComponentTypes use their position in the list as a stable ID.
+// Any other type is numbered after them in first-use order.
 template <typename T> class Component : public IComponent {
 public:
+    static constexpr int STABLE_ID = TypeIndex<T, ComponentTypes>::value;
+
     static int GetId() {
-        static auto id = nextId++;
-        return id;
+        if constexpr (STABLE_ID != -1) {
+            return STABLE_ID;
+        } else {
+            static const int id = AssignRuntimeId();
+            return id;
+        }
     }
 };
 
+// Tag and group names are interned into IDs below these limits, so that
+// membership is a single bit test
+const int MAX_TAGS = 64;
+const int MAX_GROUPS = 64;
+
+// Kills needed before Registry::Compact starts another pass
+const int COMPACTION_MIN_KILLS = 1024;
+// Entity IDs handled per unit of compaction work
+const int COMPACTION_ID_RANGE = 8192;
+
+// An entity handle packs the entity index and a generation into 32 bits. The
+// generation is bumped whenever a killed entity's index is recycled, so stale
+// handles can be told apart from the entity that now uses the index.
+const unsigned int ENTITY_INDEX_BITS = 20;
+const uint32_t ENTITY_INDEX_MASK = (1u << ENTITY_INDEX_BITS) - 1;
+const uint32_t ENTITY_GENERATION_MASK = (1u << (32 - ENTITY_INDEX_BITS)) - 1;
+
 class Entity {
 private:
-    int id;
+    uint32_t handle;
+    // Slot of the owning registry, see Registry::registries
+    uint32_t registryIndex;
 
 public:
-    Entity(int id)
-    : id(id) {};
+    Entity(int id, uint32_t generation, const class Registry *registry);
     Entity(const Entity &entity) = default;
-    int GetId() const { return id; };
+    int GetId() const { return handle & ENTITY_INDEX_MASK; };
+    uint32_t GetGeneration() const { return handle >> ENTITY_INDEX_BITS; }
+    uint32_t GetHandle() const { return handle; }
+    class Registry *GetRegistry() const;
     Entity &operator=(const Entity &other) = default;
-    bool operator==(const Entity &other) const { return id == other.id; }
-    bool operator!=(const Entity &other) const { return id != other.id; }
-    bool operator<(const Entity &other) const { return id < other.id; }
-    bool operator>(const Entity &other) const { return id > other.id; }
+    bool operator==(const Entity &other) const {
+        return handle == other.handle && registryIndex == other.registryIndex;
+    }
+    bool operator!=(const Entity &other) const { return !(*this == other); }
+    bool operator<(const Entity &other) const { return handle < other.handle; }
+    bool operator>(const Entity &other) const { return handle > other.handle; }
 
     template <typename TComponent, typename... TArgs>
     void AddComponent(TArgs &&...args);
     template <typename TComponent> void RemoveComponent();
     template <typename TComponent> bool HasComponent() const;
     template <typename TComponent> TComponent &GetComponent() const;
+    template <typename TComponent> TComponent *TryGetComponent() const;
+    template <typename TComponent> TComponent &Patch() const;
+    template <typename TComponent> void MarkChanged() const;
     void Kill();
+    bool IsAlive() const;
+    void SetEnabled(bool enabled);
+    bool IsEnabled() const;
 
     void Tag(const std::string &tag);
+    void Tag(int tagId);
     bool HasTag(const std::string &tag) const;
+    bool HasTag(int tagId) const;
     void Group(const std::string &group);
+    void Group(int groupId);
     bool BelongsToGroup(const std::string &group) const;
+    bool BelongsToGroup(int groupId) const;
+};
 
-    class Registry *registry;
+// Maps entity IDs to dense indices. The sparse array is split into fixed-size
+// pages that are allocated on first use, so a handful of high entity IDs does
+// not force a large allocation.
+// Releases the spare capacity of values once at most half of it is used.
+// Reallocating copies every element, so compaction only pays for that when
+// it frees at least as much memory as it copies.
+template <typename T> void ReleaseSpareCapacity(std::vector<T> &values) {
+    if (values.capacity() > 2 * values.size()) {
+        values.shrink_to_fit();
+    }
+}
+
+class SparseIndex {
+private:
+    static constexpr int PAGE_SIZE = 4096;
+    std::vector<std::unique_ptr<int[]>> pages;
+
+    int *AllocatePage(int page);
+
+public:
+    static constexpr int NONE = -1;
+
+    int Get(int entityId) const {
+        const unsigned int page = entityId / PAGE_SIZE;
+        if (page >= pages.size() || !pages[page]) {
+            return NONE;
+        }
+        return pages[page][entityId % PAGE_SIZE];
+    }
+
+    bool Contains(int entityId) const { return Get(entityId) != NONE; }
+
+    void Set(int entityId, int index) {
+        const unsigned int page = entityId / PAGE_SIZE;
+        int *slots = page < pages.size() && pages[page] ? pages[page].get()
+                                                        : AllocatePage(page);
+        slots[entityId % PAGE_SIZE] = index;
+    }
+
+    void Reset(int entityId) {
+        const unsigned int page = entityId / PAGE_SIZE;
+        if (page < pages.size() && pages[page]) {
+            pages[page][entityId % PAGE_SIZE] = NONE;
+        }
+    }
+
+    void Clear() { pages.clear(); }
+    // Frees the pages at or above idLimit, then the given page if it has no
+    // entries. Returns the next page to check, or -1 once all are checked.
+    int Shrink(int idLimit, int page);
 };
 
 class System {
 private:
     Signature componentSignature;
+    // Entities with any of these components never join the system
+    Signature excludedSignature;
+    // Components the system reads or writes while it runs, used to decide
+    // which systems may run at the same time
+    Signature readSignature;
+    Signature writeSignature;
     std::vector<Entity> entities;
 
+    // Sparse index = entity ID, value = position in entities
+    SparseIndex entityIndices;
+
+    ThreadPool *threadPool = nullptr;
+
+    // Change tick at which the system last began running
+    uint32_t lastRunTick = 0;
+
+    // Called whenever an entity leaves the system, to release per-entity
+    // resources
+    virtual void OnEntityRemoved(Entity entity) {}
+
 public:
-    System() = default;
-    ~System() = default;
+    System();
+    virtual ~System() = default;
     void AddEntityToSystem(Entity entity);
     void RemoveEntityFromSystem(Entity entity);
+    // Entities that do not belong to the system are ignored
+    void RemoveEntities(const std::vector<Entity> &entitiesToRemove);
+    bool HasEntity(Entity entity) const {
+        return entityIndices.Contains(entity.GetId());
+    }
     const std::vector<Entity> &GetSystemEntities() const;
+    void Clear();
+    // Releases memory held for entity IDs at or above idLimit, one part per
+    // call like IPool::Shrink
+    int Shrink(int idLimit, int cursor);
     const Signature &GetComponentSignature() const;
+    const Signature &GetExcludedSignature() const {
+        return excludedSignature;
+    }
+    bool IsInterestedIn(const Signature &entitySignature) const {
+        return componentSignature.IsSubsetOf(entitySignature) &&
+               (entitySignature & excludedSignature).none();
+    }
+    // A system that declares no component access is treated as touching
+    // everything and never runs alongside another system
+    bool ConflictsWith(const System &other) const;
     template <typename TComponent> void RequireComponent();
+    // Narrows the required components to entities without TComponent
+    template <typename TComponent> void ExcludeComponent();
+    // Systems exclude disabled entities unless they call this
+    void IncludeDisabled();
+    template <typename TComponent> void ReadsComponent();
+    template <typename TComponent> void WritesComponent();
+
+    // Starts a new run and returns the tick of the previous one, to be passed
+    // to the Changed and Added view filters
+    uint32_t BeginRun(class Registry &registry);
+
+    // Without a thread pool the parallel loops below run on the calling thread
+    void SetThreadPool(ThreadPool *threadPool) {
+        this->threadPool = threadPool;
+    }
+    // Calls fn(begin, end) for ranges of at most chunkSize system entities
+    // in parallel. Each range records its structural changes (kills, adding
+    // and removing components, enabling, tagging and grouping) into its own
+    // command buffer, and the buffers are played back in range order once
+    // every range is done, so those changes are not visible inside fn.
+    // Entities cannot be created directly inside fn; record them through
+    // Registry::GetDeferredCommands() instead.
+    template <typename TFunc> void ParallelForChunks(int chunkSize, TFunc fn);
+    // Calls fn(entity) for every system entity, chunkSize entities per job
+    template <typename TFunc> void ParallelForEach(int chunkSize, TFunc fn);
 };
 
+// Change ticks wrap around, so a tick counts as newer when it lies less than
+// half the tick range ahead
+inline bool IsNewerTick(uint32_t tick, uint32_t sinceTick) {
+    return static_cast<int32_t>(tick - sinceTick) > 0;
+}
+
+// Type-erased part of a component pool: the dense list of entity IDs that
+// own a component and the sparse index pointing into it.
 class IPool {
+protected:
+    // Dense index = component slot
+    std::vector<int> entityIds;
+    std::vector<uint32_t> addedTicks;
+    std::vector<uint32_t> changedTicks;
+
+    // Sparse index = entity ID
+    SparseIndex entityIdToIndex;
+
+    // Owned by the registry, stamped on added and changed components
+    const std::atomic<uint32_t> *changeTick = nullptr;
+
+    uint32_t GetCurrentTick() const {
+        return changeTick ? changeTick->load(std::memory_order_relaxed) : 0;
+    }
+
 public:
     virtual ~IPool() = default;
     virtual void RemoveEntity(int entityId) = 0;
+    // Releases storage the components no longer use, one part per call
+    // starting at cursor 0. Returns the cursor of the next part, or -1 once
+    // done. Entity IDs must be below idLimit.
+    virtual int Shrink(int idLimit, int cursor) = 0;
+    virtual void Clear() = 0;
+
+    bool isEmpty() const { return entityIds.empty(); }
+    unsigned int GetSize() const { return entityIds.size(); }
+    bool Contains(int entityId) const {
+        return entityIdToIndex.Contains(entityId);
+    }
+    int GetEntityId(unsigned int index) const { return entityIds[index]; }
+    int GetIndex(int entityId) const { return entityIdToIndex.Get(entityId); }
+
+    void SetChangeTick(const std::atomic<uint32_t> *tick) { changeTick = tick; }
+    uint32_t GetAddedTick(int entityId) const {
+        return addedTicks[entityIdToIndex.Get(entityId)];
+    }
+    uint32_t GetChangedTick(int entityId) const {
+        return changedTicks[entityIdToIndex.Get(entityId)];
+    }
+    // Distinct entities may be marked from different threads at once
+    void MarkChanged(int entityId) {
+        changedTicks[entityIdToIndex.Get(entityId)] = GetCurrentTick();
+    }
+    // Marks the components at dense indices first + i, for i below count,
+    // where changed(i) is true
+    template <typename TPredicate>
+    void MarkChangedWhere(
+        unsigned int first,
+        unsigned int count,
+        TPredicate changed
+    ) {
+        const uint32_t tick = GetCurrentTick();
+        uint32_t *ticks = changedTicks.data() + first;
+        for (unsigned int i = 0; i < count; i++) {
+            ticks[i] = changed(i) ? tick : ticks[i];
+        }
+    }
 };
 
+// Sparse set of components: components are packed in a dense array and the
+// sparse index resolves an entity ID to its dense slot in O(1). The dense
+// array is split into fixed-size pages that are never relocated, so adding
+// components leaves references to existing ones valid. Removing a component
+// moves the pool's last component into the freed slot.
 template <typename T> class Pool : public IPool {
+public:
+    // Components from an index to the end of its page are contiguous
+    static constexpr unsigned int PAGE_SIZE = 1024;
+
 private:
-    std::vector<T> data;
-    unsigned int size;
-    std::unordered_map<int, int> entityIdToIndex;
-    std::unordered_map<int, int> indexToEntityId;
+    struct Page {
+        alignas(T) unsigned char storage[sizeof(T) * PAGE_SIZE];
+    };
+    std::vector<std::unique_ptr<Page>> pages;
 
-public:
-    Pool(int capacity = 100) {
-        size = 0;
-        data.resize(capacity);
+    T *Slot(unsigned int index) const {
+        return reinterpret_cast<T *>(pages[index / PAGE_SIZE]->storage) +
+               index % PAGE_SIZE;
     }
-    virtual ~Pool() = default;
 
-    bool isEmpty() { return size == 0; }
+    // Entities already in place cost one ID compare, without a lookup
+    template <typename TEntityIdAt>
+    void SortAs(unsigned int count, TEntityIdAt entityIdAt) {
+        const unsigned int size = entityIds.size();
+        // Swaps keep the array where it is
+        const int *ids = entityIds.data();
+        unsigned int position = 0;
+        for (unsigned int i = 0; i < count && position < size; i++) {
+            const int entityId = entityIdAt(i);
+            if (ids[position] == entityId) {
+                position++;
+                continue;
+            }
+            const int index = entityIdToIndex.Get(entityId);
+            if (index == SparseIndex::NONE) {
+                continue;
+            }
+            Swap(index, position);
+            position++;
+        }
+    }
 
-    unsigned int GetSize() { return size; }
+    // Scratch for Sort, index = new dense index
+    std::vector<unsigned int> sortOrder;
 
-    void Clear() {
-        data.clear();
-        size = 0;
+    // Moves the component at sortOrder[i] to index i
+    void ApplySortOrder() {
+        for (unsigned int i = 0; i < sortOrder.size(); i++) {
+            if (sortOrder[i] == i) {
+                continue;
+            }
+            T held = std::move(*Slot(i));
+            const int heldEntityId = entityIds[i];
+            const uint32_t heldAddedTick = addedTicks[i];
+            const uint32_t heldChangedTick = changedTicks[i];
+            unsigned int index = i;
+            while (sortOrder[index] != i) {
+                const unsigned int source = sortOrder[index];
+                *Slot(index) = std::move(*Slot(source));
+                entityIds[index] = entityIds[source];
+                addedTicks[index] = addedTicks[source];
+                changedTicks[index] = changedTicks[source];
+                entityIdToIndex.Set(entityIds[index], index);
+                sortOrder[index] = index;
+                index = source;
+            }
+            *Slot(index) = std::move(held);
+            entityIds[index] = heldEntityId;
+            addedTicks[index] = heldAddedTick;
+            changedTicks[index] = heldChangedTick;
+            entityIdToIndex.Set(heldEntityId, index);
+            sortOrder[index] = index;
+        }
     }
 
-    void Add(T object) {
-        data.push_back(object);
+public:
+    Pool() = default;
+    Pool(const Pool &) = delete;
+    Pool &operator=(const Pool &) = delete;
+    virtual ~Pool() { Clear(); }
+
+    // Destroys all components but keeps the allocated pages
+    void Clear() override {
+        for (unsigned int index = 0; index < entityIds.size(); index++) {
+            Slot(index)->~T();
+            entityIdToIndex.Reset(entityIds[index]);
+        }
+        entityIds.clear();
+        addedTicks.clear();
+        changedTicks.clear();
     }
 
-    void Set(int entityId, T object) {
-        if (entityIdToIndex.find(entityId) != entityIdToIndex.end()) {
-            int index = entityIdToIndex[entityId];
-            data[index] = object;
-        } else {
-            unsigned int index = size;
-            entityIdToIndex.emplace(entityId, index);
-            indexToEntityId.emplace(index, entityId);
-            if (index >= data.capacity()) {
-                data.resize(size * 2);
-            }
-            data[index] = object;
-            size += 1;
+    // Constructs the component directly in pool storage. An existing
+    // component of the entity is replaced.
+    template <typename... TArgs> T &Emplace(int entityId, TArgs &&...args) {
+        const int existingIndex = entityIdToIndex.Get(entityId);
+        if (existingIndex != SparseIndex::NONE) {
+            T &component = *Slot(existingIndex);
+            component = T(std::forward<TArgs>(args)...);
+            changedTicks[existingIndex] = GetCurrentTick();
+            return component;
+        }
+
+        const unsigned int index = entityIds.size();
+        if (index / PAGE_SIZE >= pages.size()) {
+            pages.push_back(std::make_unique<Page>());
+        }
+        T *component = new (Slot(index)) T(std::forward<TArgs>(args)...);
+        entityIdToIndex.Set(entityId, index);
+        entityIds.push_back(entityId);
+        addedTicks.push_back(GetCurrentTick());
+        changedTicks.push_back(GetCurrentTick());
+        return *component;
+    }
+
+    // Allocates storage for count more components up front
+    void Reserve(unsigned int count) {
+        const unsigned int capacity = entityIds.size() + count;
+        while (pages.size() * PAGE_SIZE < capacity) {
+            pages.push_back(std::make_unique<Page>());
         }
+        entityIds.reserve(capacity);
+        addedTicks.reserve(capacity);
+        changedTicks.reserve(capacity);
     }
 
+    void Set(int entityId, T object) { Emplace(entityId, std::move(object)); }
+
     void Remove(int entityId) {
-        int indexOfRemoved = entityIdToIndex[entityId];
-        int indexOfLast = size - 1;
-        data[indexOfRemoved] = data[indexOfLast];
+        const int indexOfRemoved = entityIdToIndex.Get(entityId);
+        const int indexOfLast = entityIds.size() - 1;
+        const int entityIdOfLastElement = entityIds[indexOfLast];
 
-        int entityIdOfLastElement = indexToEntityId[indexOfLast];
-        entityIdToIndex[entityIdOfLastElement] = indexOfRemoved;
-        indexToEntityId[indexOfRemoved] = entityIdOfLastElement;
+        if (indexOfRemoved != indexOfLast) {
+            *Slot(indexOfRemoved) = std::move(*Slot(indexOfLast));
+        }
+        Slot(indexOfLast)->~T();
+        entityIds[indexOfRemoved] = entityIdOfLastElement;
+        addedTicks[indexOfRemoved] = addedTicks[indexOfLast];
+        changedTicks[indexOfRemoved] = changedTicks[indexOfLast];
+        entityIdToIndex.Set(entityIdOfLastElement, indexOfRemoved);
 
-        entityIdToIndex.erase(entityId);
-        indexToEntityId.erase(indexOfLast);
+        entityIds.pop_back();
+        addedTicks.pop_back();
+        changedTicks.pop_back();
+        entityIdToIndex.Reset(entityId);
+    }
 
-        size -= 1;
+    T &Get(int entityId) { return *Slot(entityIdToIndex.Get(entityId)); }
+    T *TryGet(int entityId) {
+        const int index = entityIdToIndex.Get(entityId);
+        return index != SparseIndex::NONE ? Slot(index) : nullptr;
     }
 
-    T& Get(int entityId) {
-        int index = entityIdToIndex[entityId];
-        return static_cast<T&>(data[index]);
+    T &operator[](unsigned int index) { return *Slot(index); }
+
+    void Swap(unsigned int a, unsigned int b) {
+        std::swap(*Slot(a), *Slot(b));
+        std::swap(entityIds[a], entityIds[b]);
+        std::swap(addedTicks[a], addedTicks[b]);
+        std::swap(changedTicks[a], changedTicks[b]);
+        entityIdToIndex.Set(entityIds[a], a);
+        entityIdToIndex.Set(entityIds[b], b);
     }
 
-    T& operator [](unsigned int index) {
-        return data[index];
+    // Insertion sort over dense indices, close to linear when the order
+    // barely changed since the previous sort. Components are then moved
+    // once each, following the cycles of the permutation.
+    template <typename TCompare> void Sort(TCompare compare) {
+        const unsigned int size = entityIds.size();
+        sortOrder.resize(size);
+        for (unsigned int i = 0; i < size; i++) {
+            sortOrder[i] = i;
+        }
+        for (unsigned int i = 1; i < size; i++) {
+            const unsigned int current = sortOrder[i];
+            unsigned int j = i;
+            while (j > 0 && compare(*Slot(current), *Slot(sortOrder[j - 1]))) {
+                sortOrder[j] = sortOrder[j - 1];
+                j--;
+            }
+            sortOrder[j] = current;
+        }
+        ApplySortOrder();
+    }
+
+    // Moves the entities the leader also holds to the front, in the leader's
+    // order, in a single pass over the leader
+    void SortAs(const IPool &leader) {
+        SortAs(leader.GetSize(), [&](unsigned int i) {
+            return leader.GetEntityId(i);
+        });
+    }
+    void SortAs(const std::vector<Entity> &entities) {
+        SortAs(entities.size(), [&](unsigned int i) {
+            return entities[i].GetId();
+        });
     }
 
     void RemoveEntity(int entityId) override {
-        if (entityIdToIndex.find(entityId) == entityIdToIndex.end()) {
+        if (!entityIdToIndex.Contains(entityId)) {
             return;
         }
         Remove(entityId);
     }
+
+    // The dense arrays go one per call, then the sparse index page by page
+    int Shrink(int idLimit, int cursor) override {
+        switch (cursor) {
+        case 0: {
+            const size_t usedPages =
+                (entityIds.size() + PAGE_SIZE - 1) / PAGE_SIZE;
+            if (pages.size() > usedPages) {
+                pages.resize(usedPages);
+            }
+            pages.shrink_to_fit();
+            sortOrder.clear();
+            sortOrder.shrink_to_fit();
+            return 1;
+        }
+        case 1:
+            ReleaseSpareCapacity(entityIds);
+            return 2;
+        case 2:
+            ReleaseSpareCapacity(addedTicks);
+            return 3;
+        case 3:
+            ReleaseSpareCapacity(changedTicks);
+            return 4;
+        }
+        const int page = entityIdToIndex.Shrink(idLimit, cursor - 4);
+        return page == -1 ? -1 : page + 4;
+    }
 };
 
+// Type-erased operations needed to move components between archetype chunks.
+struct ComponentInfo {
+    size_t size = 0;
+    size_t alignment = 1;
+    void (*moveConstruct)(void *destination, void *source) = nullptr;
+    void (*destroy)(void *component) = nullptr;
+
+    template <typename T> static ComponentInfo Of() {
+        ComponentInfo info;
+        info.size = sizeof(T);
+        info.alignment = alignof(T);
+        info.moveConstruct = [](void *destination, void *source) {
+            new (destination) T(std::move(*static_cast<T *>(source)));
+        };
+        info.destroy = [](void *component) {
+            static_cast<T *>(component)->~T();
+        };
+        return info;
+    }
+};
+
+// All entities that share one signature. Rows are packed into fixed-size
+// chunks and every component type is stored as a column inside the chunk.
+// Only the last chunk may be partially filled.
+class Archetype {
+public:
+    static constexpr size_t CHUNK_SIZE = 16 * 1024;
+
+private:
+    struct alignas(64) Chunk {
+        unsigned char bytes[CHUNK_SIZE];
+    };
+
+    Signature signature;
+    std::vector<int> componentIds;
+    std::vector<ComponentInfo> columns;
+
+    // Index = component type ID, value = byte offset of the column in a chunk
+    std::vector<size_t> columnOffsets;
+    unsigned int chunkCapacity;
+    unsigned int size = 0;
+    std::vector<std::unique_ptr<Chunk>> chunks;
+
+public:
+    Archetype(
+        const Signature &signature,
+        const std::vector<ComponentInfo> &componentInfos
+    );
+    ~Archetype();
+    Archetype(const Archetype &) = delete;
+    Archetype &operator=(const Archetype &) = delete;
+
+    const Signature &GetSignature() const { return signature; }
+    const std::vector<int> &GetComponentIds() const { return componentIds; }
+    unsigned int GetSize() const { return size; }
+    unsigned int GetChunkCount() const {
+        return (size + chunkCapacity - 1) / chunkCapacity;
+    }
+    unsigned int GetChunkSize(unsigned int chunk) const {
+        const unsigned int first = chunk * chunkCapacity;
+        return std::min(chunkCapacity, size - first);
+    }
+
+    int *GetEntityIds(unsigned int chunk) const {
+        return reinterpret_cast<int *>(chunks[chunk]->bytes);
+    }
+    template <typename T> T *GetColumn(unsigned int chunk, int componentId) {
+        return reinterpret_cast<T *>(
+            chunks[chunk]->bytes + columnOffsets[componentId]
+        );
+    }
+    void *GetComponent(unsigned int row, int componentId) {
+        const auto &chunk = chunks[row / chunkCapacity];
+        const size_t componentSize = columns[ColumnOf(componentId)].size;
+        return chunk->bytes + columnOffsets[componentId] +
+               (row % chunkCapacity) * componentSize;
+    }
+
+    // Appends a row for the entity. Its components are left unconstructed.
+    unsigned int AllocateRow(int entityId);
+    void DestroyRow(unsigned int row);
+    // Moves the last row into the freed row and returns the ID of the moved
+    // entity, or -1 if the freed row was the last one.
+    int FillRow(unsigned int row);
+    // Destroys all rows but keeps the chunks
+    void Clear();
+    // Frees the chunks past the last row
+    void Shrink();
+
+private:
+    unsigned int ColumnOf(int componentId) const;
+};
+
+// Optional component storage where entities are grouped by signature into
+// archetypes, so systems touching several components read them from the same
+// chunk. Adding or removing a component moves the entity to another archetype,
+// and the last row of the old archetype moves into the freed row. Any
+// structural change in an archetype therefore invalidates references to the
+// components of every entity in it.
+class ArchetypeStorage {
+private:
+    struct EntityLocation {
+        int archetype = -1;
+        unsigned int row = 0;
+    };
+
+    // Vector index = component type ID
+    std::vector<ComponentInfo> componentInfos;
+
+    std::vector<std::unique_ptr<Archetype>> archetypes;
+    std::unordered_map<Signature, int> archetypeIndices;
+
+    // Vector index = entity ID
+    std::vector<EntityLocation> locations;
+
+    int GetOrCreateArchetype(const Signature &signature);
+    void MoveEntity(int entityId, const Signature &signature);
+
+public:
+    ArchetypeStorage() = default;
+
+    // Records how to move and destroy T, before an archetype holds it
+    template <typename T> void RegisterComponent();
+    template <typename T, typename... TArgs>
+    T &Emplace(int entityId, TArgs &&...args);
+    // Appends a row for each new entity to the archetype of the signature in
+    // one step, leaving the components unconstructed for Construct
+    void AllocateRows(
+        const Signature &signature,
+        const std::vector<Entity> &entities
+    );
+    // Constructs a component in a row left unconstructed by AllocateRows
+    template <typename T, typename... TArgs>
+    void Construct(int entityId, TArgs &&...args);
+    void Remove(int entityId, int componentId);
+    void RemoveEntity(int entityId);
+    template <typename T> T &Get(int entityId) const;
+    void Clear();
+    // Shrinks the entity locations, then one archetype per call, like
+    // IPool::Shrink. Entity IDs must be below idLimit.
+    int Shrink(int idLimit, int cursor);
+
+    template <typename TFunc>
+    void ForEachArchetype(const Signature &signature, TFunc func) const {
+        for (const auto &archetype : archetypes) {
+            if (signature.IsSubsetOf(archetype->GetSignature()) &&
+                archetype->GetSize() > 0) {
+                func(*archetype);
+            }
+        }
+    }
+};
+
+// Iterates every entity that has all of TComponents. Iteration walks the dense
+// entity list of the smallest pool and only probes the other pools' sparse
+// indices, so the callback receives direct references into pool storage. With
+// archetype storage it walks the chunks of every matching archetype instead.
+template <typename... TComponents> class ComponentView {
+private:
+    class Registry *registry;
+    ArchetypeStorage *archetypes;
+    std::tuple<Pool<TComponents> *...> pools;
+    const IPool *orderingPool = nullptr;
+
+    struct TickFilter {
+        const IPool *pool;
+        uint32_t sinceTick;
+        bool onlyAdded;
+    };
+    std::vector<TickFilter> tickFilters;
+    Signature requiredTags;
+    Signature excludedTags;
+
+    bool PassesFilters(int entityId) const;
+    template <typename TFunc> void EachInArchetypes(TFunc func) const;
+
+public:
+    ComponentView(
+        Registry *registry,
+        ArchetypeStorage *archetypes,
+        Pool<TComponents> *...pools
+    )
+    : registry(registry),
+      archetypes(archetypes),
+      pools(pools...) {
+        static_assert(
+            (!IS_TAG_COMPONENT<TComponents> && ...),
+            "Tag components have no storage to view, filter with With<T>()"
+        );
+        excludedTags.set(Component<DisabledComponent>::GetId());
+    }
+
+    // Only visit entities whose TComponent was added or marked changed after
+    // sinceTick. Only Patch and MarkChanged mark a change; writes through
+    // GetComponent references are invisible here. Archetype storage keeps no
+    // ticks, so there every entity passes.
+    template <typename TComponent> ComponentView &Changed(uint32_t sinceTick);
+    // Only visit entities whose TComponent was added after sinceTick
+    template <typename TComponent> ComponentView &Added(uint32_t sinceTick);
+    // Only visit entities that also carry the tag component TTag
+    template <typename TTag> ComponentView &With();
+    // Visit entities in the dense order of TComponent's pool, e.g. after
+    // Registry::Sort, instead of the order of the smallest pool
+    template <typename TComponent> ComponentView &InOrderOf();
+    // Also visit disabled entities, which are skipped by default
+    ComponentView &IncludeDisabled() {
+        excludedTags.reset(Component<DisabledComponent>::GetId());
+        return *this;
+    }
+    template <typename TFunc> void Each(TFunc func) const;
+};
+
+// Handle to an immutable value stored once by Registry::Share. Entities add
+// the handle as the component Shared<T>, so any number of them reference a
+// single copy of the value.
+template <typename T> class Shared {
+private:
+    uint32_t index;
+
+public:
+    explicit Shared(uint32_t index) : index(index) {}
+    uint32_t GetIndex() const { return index; }
+    bool operator==(const Shared &other) const { return index == other.index; }
+    bool operator!=(const Shared &other) const { return index != other.index; }
+};
+
+struct ISharedValues {
+    virtual ~ISharedValues() = default;
+};
+
+// Shared values never move, so references to them stay valid
+template <typename T> struct SharedValues : public ISharedValues {
+    std::deque<T> values;
+};
+
+enum class ComponentStorage { Pools, Archetypes };
+
+class CommandBuffer;
+class Prefab;
+
 class Registry {
 private:
+    // Every live registry, so entity handles only need a small slot index
+    static std::vector<Registry *> registries;
+    uint32_t registryIndex;
+
     int numEntities = 0;
-    std::set<Entity> entitiesToBeAdded;
-    std::set<Entity> entitiesToBeKilled;
+    std::vector<Entity> entitiesToBeUpdated;
+    std::vector<Entity> entitiesToBeKilled;
+    std::mutex entitiesToBeKilledMutex;
     std::deque<int> freeIds;
 
+    // Progress of the incremental compaction pass: the step, -1 while none
+    // runs, and the position inside the step
+    int compactionStep = -1;
+    int compactionCursor = 0;
+    int killsSinceCompaction = 0;
+    // The free IDs as of the start of the pass, sorted by it. IDs freed
+    // during the pass go to freeIds.
+    std::deque<int> compactionFreeIds;
+    // Index = entity ID below the ID limit at the start of the pass
+    std::vector<char> compactionIsFree;
+    // Each runs one unit of work from cursor and returns the cursor to
+    // continue from, or -1 once the step is done
+    int RunCompactionStep(int step, int cursor);
+    int MarkFreeIds(int cursor);
+    int SortFreeIds(int cursor);
+    int TrimEntityIds(int cursor);
+
+    // Set while a parallel loop chunk runs on this thread
+    static thread_local CommandBuffer *deferredCommands;
+    // Record into deferredCommands, defined in CommandBuffer.h
+    template <typename TComponent, typename... TArgs>
+    static void DeferAddComponent(Entity entity, TArgs &&...args);
+    template <typename TComponent>
+    static void DeferRemoveComponent(Entity entity);
+
+    ThreadPool *threadPool = nullptr;
+
+    // Stamped on components when they are added or marked changed
+    std::atomic<uint32_t> changeTick{1};
+
+    // Vector index = component type ID of the shared value type
+    std::vector<std::unique_ptr<ISharedValues>> sharedValues;
+
+    // Played back in creation order at the start of every update
+    std::vector<std::unique_ptr<CommandBuffer>> commandBuffers;
+
+    // Vector index = entity ID, set while the entity sits in a queue
+    std::vector<bool> isQueuedForUpdate;
+    std::vector<bool> isQueuedForKill;
+
     // Vector index = component type ID
     // Pool index = entity ID
-    std::vector<std::shared_ptr<IPool>> componentPools;
+    std::vector<std::unique_ptr<IPool>> componentPools;
+
+    // Replaces componentPools when the registry uses archetype storage
+    std::unique_ptr<ArchetypeStorage> archetypes;
 
     // Vector index = entity ID
+    std::vector<uint32_t> entityGenerations;
     std::vector<Signature> entityComponentSignatures;
+    // Signatures as of the last system membership update
+    std::vector<Signature> entitySystemSignatures;
 
-    std::unordered_map<std::type_index, std::shared_ptr<System>> systems;
+    std::unordered_map<std::type_index, std::unique_ptr<System>> systems;
 
-    std::unordered_map<std::string, Entity> entityPerTag;
-    std::unordered_map<int, std::string> tagPerEntity;
-    std::unordered_map<std::string, std::set<Entity>> entitiesPerGroup;
-    std::unordered_map<int, std::string> groupPerEntity;
+    // Vector index = component type ID, value = systems requiring it
+    std::vector<std::vector<System *>> systemsPerComponent;
+    std::vector<System *> affectedSystems;
+
+    IPool *FindPool(int componentId) const {
+        if (componentId >= static_cast<int>(componentPools.size())) {
+            return nullptr;
+        }
+        return componentPools[componentId].get();
+    }
+    void ResizeEntityStorage(int size);
+    // IDs AllocateEntityId can hand out without growing the ID space
+    int CountFreeIds() const;
+    int AllocateEntityId();
+    // Removes the entities from all storage right away and frees their IDs
+    void DestroyEntities(const std::vector<Entity> &entities);
+    template <typename TComponent> Pool<TComponent> &GetOrCreatePool();
+    template <typename T> const SharedValues<T> *FindSharedValues() const;
+    // AddComponent without logging, used for batched command playback
+    template <typename TComponent, typename... TArgs>
+    void EmplaceComponent(Entity entity, TArgs &&...args);
+    void RegisterSystem(System *system);
+    void UnregisterSystem(System *system);
+    void CollectAffectedSystems(const Signature &changedComponents);
+    void QueueForUpdate(Entity entity) {
+        if (!isQueuedForUpdate[entity.GetId()]) {
+            isQueuedForUpdate[entity.GetId()] = true;
+            entitiesToBeUpdated.push_back(entity);
+        }
+    }
+
+    // Shared by every registry, like component IDs
+    static std::unordered_map<std::string, int> tagIds;
+    static std::unordered_map<std::string, int> groupIds;
+    static std::mutex namesMutex;
+
+    static int InternName(
+        std::unordered_map<std::string, int> &ids,
+        const std::string &name,
+        int limit
+    );
+    static int FindName(
+        const std::unordered_map<std::string, int> &ids,
+        const std::string &name
+    );
+
+    // Vector index = entity ID, bit index = tag or group ID
+    std::vector<uint64_t> entityTagMasks;
+    std::vector<uint64_t> entityGroupMasks;
+
+    // Vector index = tag ID, value = ID of the tagged entity or -1
+    std::vector<int> taggedEntityIds;
+
+    struct GroupMembers {
+        std::vector<Entity> entities;
+        // Sparse index = entity ID, value = position in entities
+        SparseIndex positions;
+    };
+    // Vector index = group ID
+    std::vector<GroupMembers> groups;
 
 public:
-    Registry() = default;
+    Registry(ComponentStorage storage = ComponentStorage::Pools);
+    ~Registry();
+    Registry(const Registry &) = delete;
+    Registry &operator=(const Registry &) = delete;
     void Update();
 
+    // Throws std::length_error once every entity index is in use
     Entity CreateEntity();
+    // The buffer lives as long as the registry. Each buffer must only be
+    // recorded from one thread at a time.
+    CommandBuffer &CreateCommandBuffer();
+    // Creates count entities holding copies of the prefab's components
+    std::vector<Entity> Instantiate(const Prefab &prefab, int count);
+    // Also calls init(entity, index) on each new entity, to set per-instance
+    // values
+    template <typename TFunc>
+    std::vector<Entity>
+    Instantiate(const Prefab &prefab, int count, TFunc init);
+    // Runs the current compaction pass until the budget is used up, and
+    // continues it on the next call. A pass starts once COMPACTION_MIN_KILLS
+    // entities have been killed since the last one. It releases unused pool
+    // storage, sorts the free IDs so low ones are reused first, and trims free
+    // IDs off the top of the ID space. The work is split into units of
+    // COMPACTION_ID_RANGE IDs or one storage page, and the budget is checked
+    // after each, so a call overruns it by at most one unit. Call it between
+    // updates, while no system runs.
+    void Compact(std::chrono::microseconds budget);
+    // Destroys every entity and discards pending command buffer commands,
+    // keeping pool, system and group storage for the next level. Systems
+    // and shared values stay. Existing entity handles become stale. Call it
+    // between updates, while no system runs.
+    void Clear();
+    // Safe to call from systems running in parallel; other structural
+    // changes must happen while no other system runs
     void KillEntity(Entity entity);
+    // Records the structural changes of the calling thread into buffer
+    // instead of applying them, or stops when it is null; returns the
+    // previous buffer
+    static CommandBuffer *DeferTo(CommandBuffer *buffer);
+    // The buffer set by DeferTo on the calling thread, or null
+    static CommandBuffer *GetDeferredCommands() { return deferredCommands; }
+    // Shared with every current and future system
+    void SetThreadPool(ThreadPool *threadPool);
+    bool IsAlive(Entity entity) const {
+        const int entityId = entity.GetId();
+        return entityId < numEntities &&
+               entityGenerations[entityId] == entity.GetGeneration();
+    }
+    // A disabled entity keeps its components but leaves every system on the
+    // next update and is skipped by views. Toggling only flips a signature
+    // bit, so no component is moved or freed.
+    void SetEntityEnabled(Entity entity, bool enabled);
+    bool IsEntityEnabled(Entity entity) const {
+        return !entityComponentSignatures[entity.GetId()].test(
+            Component<DisabledComponent>::GetId()
+        );
+    }
+    // Handle for the entity currently using the index
+    Entity GetEntity(int entityId) const {
+        return Entity(entityId, entityGenerations[entityId], this);
+    }
 
     template <typename TComponent, typename... TArgs>
     void AddComponent(Entity entity, TArgs &&...args);
     template <typename TComponent> void RemoveComponent(Entity entity);
     template <typename TComponent> bool HasComponent(Entity entity) const;
+    // Allocates storage for count more components of the type
+    template <typename TComponent> void Reserve(unsigned int count);
     template <typename TComponent>
     TComponent &GetComponent(Entity entity) const;
+    // Null when the entity does not have the component
+    template <typename TComponent>
+    TComponent *TryGetComponent(Entity entity) const;
+    // Mutable access that also marks the component as changed
+    template <typename TComponent> TComponent &Patch(Entity entity);
+    template <typename TComponent> void MarkChanged(Entity entity);
+    uint32_t GetChangeTick() const { return changeTick; }
+    // Starts a new change tick and returns the one that ended
+    uint32_t AdvanceChangeTick() { return changeTick++; }
+    // Looks up the components of count entities, resolving the storage once
+    template <typename TComponent>
+    void GetComponents(
+        const Entity *entities,
+        int count,
+        TComponent **components
+    ) const;
+    // Pools are owned by the registry; the component must have been added to
+    // at least one entity before its pool can be accessed.
+    template <typename TComponent> Pool<TComponent> &GetPool() const;
+    template <typename... TComponents>
+    ComponentView<TComponents...> View() const;
+    // Sorts the pool by compare(a, b) on two components, cheaply when the
+    // order barely changed since the last sort. Components move, so
+    // references to them are invalidated. Archetype storage cannot be
+    // reordered and returns false.
+    template <typename TComponent, typename TCompare>
+    bool Sort(TCompare compare);
+    // Orders the TComponent pool like the TLeader pool, with entities that
+    // lack TLeader at the end
+    template <typename TComponent, typename TLeader> bool SortAs();
+    // Orders the TComponent pool like entities, which must all have the
+    // component, so pool index i holds the component of entities[i]
+    template <typename TComponent>
+    bool SortAs(const std::vector<Entity> &entities);
+
+    // Stores the value once and returns the handle entities add as Shared<T>
+    template <typename T> Shared<T> Share(T value);
+    template <typename T> const T &GetShared(Shared<T> shared) const;
+    // Calls func(value, entities, count) once for every shared value that
+    // entities reference, passing all of them together
+    template <typename T, typename TFunc> void EachShared(TFunc func) const;
 
     template <typename TSystem, typename... TArgs>
     void AddSystem(TArgs &&...args);
     template <typename TSystem> void RemoveSystem();
     template <typename TSystem> bool HasSystem() const;
     template <typename TSystem> TSystem &GetSystem() const;
-    void AddEntityToSystems(Entity entity);
-    void RemoveEntityFromSystems(Entity entity);
+    void UpdateEntityInSystems(Entity entity);
+
+    // Returns the ID of a tag or group name, assigning one on first use.
+    // Systems can look the ID up once and use the ID overloads below, which
+    // expect a valid ID. Throws std::length_error past MAX_TAGS or
+    // MAX_GROUPS names.
+    static int GetTagId(const std::string &tag);
+    static int GetGroupId(const std::string &group);
 
+    // A tag names at most one entity; tagging another entity moves it
     void TagEntity(Entity entity, const std::string &tag);
+    void TagEntity(Entity entity, int tagId);
     bool EntityHasTag(Entity entity, const std::string &tag) const;
+    bool EntityHasTag(Entity entity, int tagId) const {
+        assert(tagId >= 0 && tagId < MAX_TAGS);
+        return (entityTagMasks[entity.GetId()] >> tagId) & 1;
+    }
+    bool TagExists(const std::string &tag) const;
+    bool TagExists(int tagId) const;
+    // Throws std::out_of_range when no entity has the tag
     Entity GetEntityByTag(const std::string &tag) const;
+    Entity GetEntityByTag(int tagId) const;
     void RemoveEntityTag(Entity entity);
 
+    // An entity may belong to several groups
     void GroupEntity(Entity entity, const std::string &group);
+    void GroupEntity(Entity entity, int groupId);
     bool EntityBelongsToGroup(Entity entity, const std::string &group) const;
-    std::vector<Entity> GetEntitiesByGroup(const std::string &group) const;
+    bool EntityBelongsToGroup(Entity entity, int groupId) const {
+        assert(groupId >= 0 && groupId < MAX_GROUPS);
+        return (entityGroupMasks[entity.GetId()] >> groupId) & 1;
+    }
+    const std::vector<Entity> &GetEntitiesByGroup(const std::string &group
+    ) const;
+    const std::vector<Entity> &GetEntitiesByGroup(int groupId) const;
+    // Removes the entity from all of its groups
     void RemoveEntityGroup(Entity entity);
+    // Destroys every entity of the group right away, like Clear
+    void ClearGroup(const std::string &group);
+    void ClearGroup(int groupId);
+
+    friend class Entity;
+    friend class CommandBuffer;
+    friend class Prefab;
+    template <typename... TComponents> friend class ComponentView;
 };
 
+inline Entity::Entity(int id, uint32_t generation, const Registry *registry)
+: handle(static_cast<uint32_t>(id) | generation << ENTITY_INDEX_BITS),
+  registryIndex(registry->registryIndex) {}
+
+inline Registry *Entity::GetRegistry() const {
+    return Registry::registries[registryIndex];
+}
+
+inline bool Entity::HasTag(int tagId) const {
+    return GetRegistry()->EntityHasTag(*this, tagId);
+}
+
+inline bool Entity::BelongsToGroup(int groupId) const {
+    return GetRegistry()->EntityBelongsToGroup(*this, groupId);
+}
+
 template <typename TComponent> void System::RequireComponent() {
     const auto componentId = Component<TComponent>::GetId();
     componentSignature.set(componentId);
 }
 
+template <typename TComponent> void System::ExcludeComponent() {
+    excludedSignature.set(Component<TComponent>::GetId());
+}
+
+template <typename TComponent> void System::ReadsComponent() {
+    readSignature.set(Component<TComponent>::GetId());
+}
+
+template <typename TComponent> void System::WritesComponent() {
+    writeSignature.set(Component<TComponent>::GetId());
+}
+
+template <typename TFunc>
+void System::ParallelForEach(int chunkSize, TFunc fn) {
+    ParallelForChunks(chunkSize, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            fn(entities[i]);
+        }
+    });
+}
+
 template <typename TComponent, typename... TArgs>
 void Entity::AddComponent(TArgs &&...args) {
-    registry->AddComponent<TComponent>(*this, std::forward<TArgs>(args)...);
+    GetRegistry()->AddComponent<TComponent>(
+        *this, std::forward<TArgs>(args)...
+    );
 }
 
 template <typename TComponent> void Entity::RemoveComponent() {
-    registry->RemoveComponent<TComponent>(*this);
+    GetRegistry()->RemoveComponent<TComponent>(*this);
 }
 
 template <typename TComponent> bool Entity::HasComponent() const {
-    return registry->HasComponent<TComponent>(*this);
+    return GetRegistry()->HasComponent<TComponent>(*this);
 }
 
 template <typename TComponent> TComponent &Entity::GetComponent() const {
-    return registry->GetComponent<TComponent>(*this);
+    return GetRegistry()->GetComponent<TComponent>(*this);
+}
+
+template <typename TComponent>
+TComponent *Entity::TryGetComponent() const {
+    return GetRegistry()->TryGetComponent<TComponent>(*this);
+}
+
+template <typename TComponent> TComponent &Entity::Patch() const {
+    return GetRegistry()->Patch<TComponent>(*this);
+}
+
+template <typename TComponent> void Entity::MarkChanged() const {
+    GetRegistry()->MarkChanged<TComponent>(*this);
 }
 
 template <typename TComponent, typename... TArgs>
 void Registry::AddComponent(Entity entity, TArgs &&...args) {
-    const auto componentId = Component<TComponent>::GetId();
+    EmplaceComponent<TComponent>(entity, std::forward<TArgs>(args)...);
+    if (deferredCommands != nullptr) {
+        return;
+    }
+    Logger::Log(
+        "Component id = " + std::to_string(Component<TComponent>::GetId()) +
+        " was added to entity id " + std::to_string(entity.GetId())
+    );
+}
+
+template <typename TComponent, typename... TArgs>
+void Registry::EmplaceComponent(Entity entity, TArgs &&...args) {
+    if (deferredCommands != nullptr) {
+        DeferAddComponent<TComponent>(entity, std::forward<TArgs>(args)...);
+        return;
+    }
     const auto entityId = entity.GetId();
+    QueueForUpdate(entity);
 
+    if constexpr (!IS_TAG_COMPONENT<TComponent>) {
+        if (archetypes) {
+            archetypes->Emplace<TComponent>(
+                entityId, std::forward<TArgs>(args)...
+            );
+        } else {
+            GetOrCreatePool<TComponent>().Emplace(
+                entityId, std::forward<TArgs>(args)...
+            );
+        }
+    }
+    entityComponentSignatures[entityId].set(Component<TComponent>::GetId());
+}
+
+template <typename TComponent>
+Pool<TComponent> &Registry::GetOrCreatePool() {
+    const auto componentId = Component<TComponent>::GetId();
     if (componentId >= static_cast<int>(componentPools.size())) {
-        componentPools.resize(componentId + 1, nullptr);
+        componentPools.resize(componentId + 1);
     }
     if (!componentPools[componentId]) {
-        std::shared_ptr<Pool<TComponent>> newComponentPool =
-            std::make_shared<Pool<TComponent>>();
-        componentPools[componentId] = newComponentPool;
+        componentPools[componentId] = std::make_unique<Pool<TComponent>>();
+        componentPools[componentId]->SetChangeTick(&changeTick);
     }
-    std::shared_ptr<Pool<TComponent>> componentPool =
-        std::static_pointer_cast<Pool<TComponent>>(componentPools[componentId]);
+    return GetPool<TComponent>();
+}
 
-    TComponent newComponent(std::forward<TArgs>(args)...);
-    componentPool->Set(entityId, newComponent);
-    entityComponentSignatures[entityId].set(componentId);
+template <typename TFunc>
+std::vector<Entity>
+Registry::Instantiate(const Prefab &prefab, int count, TFunc init) {
+    auto entities = Instantiate(prefab, count);
+    for (int i = 0; i < count; i++) {
+        init(entities[i], i);
+    }
+    return entities;
+}
 
-    Logger::Log(
-        "Component id = " + std::to_string(componentId) +
-        " was added to entity id " + std::to_string(entityId)
-    );
+template <typename TComponent> void Registry::Reserve(unsigned int count) {
+    if constexpr (!IS_TAG_COMPONENT<TComponent>) {
+        if (!archetypes) {
+            GetOrCreatePool<TComponent>().Reserve(count);
+        }
+    }
 }
 
 template <typename TComponent> void Registry::RemoveComponent(Entity entity) {
+    if (deferredCommands != nullptr) {
+        DeferRemoveComponent<TComponent>(entity);
+        return;
+    }
     const auto componentId = Component<TComponent>::GetId();
     const auto entityId = entity.GetId();
+    QueueForUpdate(entity);
 
-    std::shared_ptr<Pool<TComponent>> componentPool =
-        std::static_pointer_cast<Pool<TComponent>>(componentPools[componentId]);
-    componentPool->Remove(entityId);
+    if constexpr (!IS_TAG_COMPONENT<TComponent>) {
+        if (archetypes) {
+            archetypes->Remove(entityId, componentId);
+        } else {
+            GetPool<TComponent>().Remove(entityId);
+        }
+    }
 
     entityComponentSignatures[entityId].set(componentId, false);
 }
@@ -275,22 +1272,372 @@ bool Registry::HasComponent(Entity entity) const {
 
 template <typename TComponent>
 TComponent &Registry::GetComponent(Entity entity) const {
-    const auto componentId = Component<TComponent>::GetId();
+    static_assert(
+        !IS_TAG_COMPONENT<TComponent>,
+        "Tag components have no data, use HasComponent instead"
+    );
     const auto entityId = entity.GetId();
-    const auto componentPool =
-        std::static_pointer_cast<Pool<TComponent>>(componentPools[componentId]);
-    return componentPool->Get(entityId);
+    if (archetypes) {
+        return archetypes->Get<TComponent>(entityId);
+    }
+    return GetPool<TComponent>().Get(entityId);
+}
+
+template <typename TComponent>
+TComponent *Registry::TryGetComponent(Entity entity) const {
+    static_assert(
+        !IS_TAG_COMPONENT<TComponent>,
+        "Tag components have no data, use HasComponent instead"
+    );
+    const auto componentId = Component<TComponent>::GetId();
+    if (archetypes) {
+        if (!HasComponent<TComponent>(entity)) {
+            return nullptr;
+        }
+        return &GetComponent<TComponent>(entity);
+    }
+    auto *pool = static_cast<Pool<TComponent> *>(FindPool(componentId));
+    return pool ? pool->TryGet(entity.GetId()) : nullptr;
+}
+
+template <typename TComponent> TComponent &Registry::Patch(Entity entity) {
+    MarkChanged<TComponent>(entity);
+    return GetComponent<TComponent>(entity);
+}
+
+template <typename TComponent> void Registry::MarkChanged(Entity entity) {
+    if (!archetypes) {
+        GetPool<TComponent>().MarkChanged(entity.GetId());
+    }
+}
+
+template <typename TComponent>
+void Registry::GetComponents(
+    const Entity *entities,
+    int count,
+    TComponent **components
+) const {
+    if (archetypes) {
+        for (int i = 0; i < count; i++) {
+            components[i] = &archetypes->Get<TComponent>(entities[i].GetId());
+        }
+        return;
+    }
+    auto &pool = GetPool<TComponent>();
+    for (int i = 0; i < count; i++) {
+        components[i] = &pool.Get(entities[i].GetId());
+    }
+}
+
+template <typename TComponent> Pool<TComponent> &Registry::GetPool() const {
+    static_assert(
+        !IS_TAG_COMPONENT<TComponent>, "Tag components have no pool"
+    );
+    const auto componentId = Component<TComponent>::GetId();
+    return *static_cast<Pool<TComponent> *>(componentPools[componentId].get());
+}
+
+template <typename... TComponents>
+ComponentView<TComponents...> Registry::View() const {
+    return ComponentView<TComponents...>(
+        const_cast<Registry *>(this),
+        archetypes.get(),
+        static_cast<Pool<TComponents> *>(
+            FindPool(Component<TComponents>::GetId())
+        )...
+    );
+}
+
+template <typename TComponent, typename TCompare>
+bool Registry::Sort(TCompare compare) {
+    if (archetypes) {
+        return false;
+    }
+    if (FindPool(Component<TComponent>::GetId())) {
+        GetPool<TComponent>().Sort(compare);
+    }
+    return true;
+}
+
+template <typename TComponent, typename TLeader> bool Registry::SortAs() {
+    if (archetypes) {
+        return false;
+    }
+    const IPool *leader = FindPool(Component<TLeader>::GetId());
+    if (leader && FindPool(Component<TComponent>::GetId())) {
+        GetPool<TComponent>().SortAs(*leader);
+    }
+    return true;
+}
+
+template <typename TComponent>
+bool Registry::SortAs(const std::vector<Entity> &entities) {
+    if (archetypes) {
+        return false;
+    }
+    if (!entities.empty()) {
+        GetPool<TComponent>().SortAs(entities);
+    }
+    return true;
+}
+
+template <typename T>
+const SharedValues<T> *Registry::FindSharedValues() const {
+    const auto componentId = Component<T>::GetId();
+    if (componentId >= static_cast<int>(sharedValues.size())) {
+        return nullptr;
+    }
+    return static_cast<const SharedValues<T> *>(
+        sharedValues[componentId].get()
+    );
+}
+
+template <typename T> Shared<T> Registry::Share(T value) {
+    const auto componentId = Component<T>::GetId();
+    if (componentId >= static_cast<int>(sharedValues.size())) {
+        sharedValues.resize(componentId + 1);
+    }
+    if (!sharedValues[componentId]) {
+        sharedValues[componentId] = std::make_unique<SharedValues<T>>();
+    }
+    auto &values =
+        static_cast<SharedValues<T> &>(*sharedValues[componentId]).values;
+    values.push_back(std::move(value));
+    return Shared<T>(values.size() - 1);
+}
+
+template <typename T>
+const T &Registry::GetShared(Shared<T> shared) const {
+    return FindSharedValues<T>()->values[shared.GetIndex()];
+}
+
+template <typename T, typename TFunc>
+void Registry::EachShared(TFunc func) const {
+    const auto *shared = FindSharedValues<T>();
+    if (!shared) {
+        return;
+    }
+
+    // Counting sort of the referencing entities by value
+    std::vector<int> offsets(shared->values.size() + 1, 0);
+    View<Shared<T>>().Each([&](Entity, const Shared<T> &handle) {
+        offsets[handle.GetIndex() + 1]++;
+    });
+    for (size_t i = 1; i < offsets.size(); i++) {
+        offsets[i] += offsets[i - 1];
+    }
+    std::vector<Entity> entities(offsets.back(), Entity(0, 0, this));
+    std::vector<int> next(offsets.begin(), offsets.end() - 1);
+    View<Shared<T>>().Each([&](Entity entity, const Shared<T> &handle) {
+        entities[next[handle.GetIndex()]++] = entity;
+    });
+
+    for (size_t i = 0; i + 1 < offsets.size(); i++) {
+        const int count = offsets[i + 1] - offsets[i];
+        if (count > 0) {
+            func(shared->values[i], entities.data() + offsets[i], count);
+        }
+    }
+}
+
+template <typename... TComponents>
+template <typename TComponent>
+ComponentView<TComponents...> &
+ComponentView<TComponents...>::Changed(uint32_t sinceTick) {
+    const IPool *pool = registry->FindPool(Component<TComponent>::GetId());
+    tickFilters.push_back({pool, sinceTick, false});
+    return *this;
+}
+
+template <typename... TComponents>
+template <typename TComponent>
+ComponentView<TComponents...> &
+ComponentView<TComponents...>::Added(uint32_t sinceTick) {
+    const IPool *pool = registry->FindPool(Component<TComponent>::GetId());
+    tickFilters.push_back({pool, sinceTick, true});
+    return *this;
+}
+
+template <typename... TComponents>
+template <typename TTag>
+ComponentView<TComponents...> &ComponentView<TComponents...>::With() {
+    static_assert(IS_TAG_COMPONENT<TTag>, "With<T>() expects a tag component");
+    requiredTags.set(Component<TTag>::GetId());
+    return *this;
+}
+
+template <typename... TComponents>
+template <typename TComponent>
+ComponentView<TComponents...> &ComponentView<TComponents...>::InOrderOf() {
+    static_assert(
+        (std::is_same_v<TComponent, TComponents> || ...),
+        "InOrderOf<T>() expects one of the viewed components"
+    );
+    orderingPool = std::get<Pool<TComponent> *>(pools);
+    return *this;
+}
+
+template <typename... TComponents>
+bool ComponentView<TComponents...>::PassesFilters(int entityId) const {
+    const auto &signature = registry->entityComponentSignatures[entityId];
+    if (!requiredTags.IsSubsetOf(signature) ||
+        (signature & excludedTags).any()) {
+        return false;
+    }
+    for (const auto &filter : tickFilters) {
+        if (!filter.pool || !filter.pool->Contains(entityId)) {
+            return false;
+        }
+        const uint32_t tick = filter.onlyAdded
+                                  ? filter.pool->GetAddedTick(entityId)
+                                  : filter.pool->GetChangedTick(entityId);
+        if (!IsNewerTick(tick, filter.sinceTick)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename... TComponents>
+template <typename TFunc>
+void ComponentView<TComponents...>::Each(TFunc func) const {
+    if (archetypes) {
+        EachInArchetypes(func);
+        return;
+    }
+
+    const IPool *candidates[] = {std::get<Pool<TComponents> *>(pools)...};
+    const IPool *smallest = orderingPool;
+    for (const IPool *pool : candidates) {
+        if (!pool) {
+            return;
+        }
+        if (!orderingPool &&
+            (!smallest || pool->GetSize() < smallest->GetSize())) {
+            smallest = pool;
+        }
+    }
+
+    // Entities added to the iterated pools from the callback are not visited
+    const unsigned int size = smallest->GetSize();
+    for (unsigned int i = 0; i < size; i++) {
+        const int entityId = smallest->GetEntityId(i);
+        bool hasAll = true;
+        for (const IPool *pool : candidates) {
+            hasAll = hasAll && (pool == smallest || pool->Contains(entityId));
+        }
+        if (!hasAll || !PassesFilters(entityId)) {
+            continue;
+        }
+
+        auto component = [smallest, i, entityId](auto *pool) -> auto & {
+            return pool == smallest ? (*pool)[i] : pool->Get(entityId);
+        };
+        func(
+            registry->GetEntity(entityId),
+            component(std::get<Pool<TComponents> *>(pools))...
+        );
+    }
+}
+
+template <typename... TComponents>
+template <typename TFunc>
+void ComponentView<TComponents...>::EachInArchetypes(TFunc func) const {
+    Signature signature;
+    (signature.set(Component<TComponents>::GetId()), ...);
+
+    archetypes->ForEachArchetype(signature, [&](Archetype &archetype) {
+        for (unsigned int chunk = 0; chunk < archetype.GetChunkCount();
+             chunk++) {
+            const unsigned int size = archetype.GetChunkSize(chunk);
+            const int *entityIds = archetype.GetEntityIds(chunk);
+            auto columns = std::make_tuple(archetype.GetColumn<TComponents>(
+                chunk, Component<TComponents>::GetId()
+            )...);
+            for (unsigned int i = 0; i < size; i++) {
+                const auto &signature =
+                    registry->entityComponentSignatures[entityIds[i]];
+                if (!requiredTags.IsSubsetOf(signature) ||
+                    (signature & excludedTags).any()) {
+                    continue;
+                }
+                func(
+                    registry->GetEntity(entityIds[i]),
+                    std::get<TComponents *>(columns)[i]...
+                );
+            }
+        }
+    });
+}
+
+template <typename T> void ArchetypeStorage::RegisterComponent() {
+    const auto componentId = Component<T>::GetId();
+    if (componentId >= static_cast<int>(componentInfos.size())) {
+        componentInfos.resize(componentId + 1);
+    }
+    if (!componentInfos[componentId].moveConstruct) {
+        componentInfos[componentId] = ComponentInfo::Of<T>();
+    }
+}
+
+template <typename T, typename... TArgs>
+T &ArchetypeStorage::Emplace(int entityId, TArgs &&...args) {
+    const auto componentId = Component<T>::GetId();
+    RegisterComponent<T>();
+    if (entityId >= static_cast<int>(locations.size())) {
+        locations.resize(entityId + 1);
+    }
+
+    Signature signature;
+    const auto &location = locations[entityId];
+    if (location.archetype != -1) {
+        auto &archetype = *archetypes[location.archetype];
+        signature = archetype.GetSignature();
+        if (signature.test(componentId)) {
+            T &component = *static_cast<T *>(
+                archetype.GetComponent(location.row, componentId)
+            );
+            component = T(std::forward<TArgs>(args)...);
+            return component;
+        }
+    }
+
+    signature.set(componentId);
+    MoveEntity(entityId, signature);
+    const auto &newLocation = locations[entityId];
+    void *slot = archetypes[newLocation.archetype]->GetComponent(
+        newLocation.row, componentId
+    );
+    return *new (slot) T(std::forward<TArgs>(args)...);
+}
+
+template <typename T, typename... TArgs>
+void ArchetypeStorage::Construct(int entityId, TArgs &&...args) {
+    const auto &location = locations[entityId];
+    void *slot = archetypes[location.archetype]->GetComponent(
+        location.row, Component<T>::GetId()
+    );
+    new (slot) T(std::forward<TArgs>(args)...);
+}
+
+template <typename T> T &ArchetypeStorage::Get(int entityId) const {
+    const auto &location = locations[entityId];
+    return *static_cast<T *>(archetypes[location.archetype]->GetComponent(
+        location.row, Component<T>::GetId()
+    ));
 }
 
 template <typename TSystem, typename... TArgs>
 void Registry::AddSystem(TArgs &&...args) {
-    std::shared_ptr<TSystem> newSystem =
-        std::make_shared<TSystem>(std::forward<TArgs>(args)...);
-    systems.insert(std::make_pair(std::type_index(typeid(TSystem)), newSystem));
+    auto newSystem = std::make_unique<TSystem>(std::forward<TArgs>(args)...);
+    newSystem->SetThreadPool(threadPool);
+    RegisterSystem(newSystem.get());
+    systems.emplace(std::type_index(typeid(TSystem)), std::move(newSystem));
 }
 
 template <typename TSystem> void Registry::RemoveSystem() {
     auto system = systems.find(std::type_index(typeid(TSystem)));
+    UnregisterSystem(system->second.get());
     systems.erase(system);
 }
 
@@ -300,5 +1647,8 @@ template <typename TSystem> bool Registry::HasSystem() const {
 
 template <typename TSystem> TSystem &Registry::GetSystem() const {
     const auto pair = systems.find(std::type_index(typeid(TSystem)));
-    return *(std::static_pointer_cast<TSystem>(pair->second));
+    return *static_cast<TSystem *>(pair->second.get());
 }
+
+// Defines the templates above that record into command buffers
+#include "CommandBuffer.h"
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "ECS.h"
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// A component set with default values. Registry::Instantiate copies it onto
+// many new entities at once, one pass per component type.
+class Prefab {
+private:
+    struct IPrefabComponent {
+        virtual ~IPrefabComponent() = default;
+        virtual void RegisterComponent(ArchetypeStorage &archetypes) const = 0;
+        // With archetype storage, constructs the component in rows the
+        // registry allocated for the whole prefab signature
+        virtual void Instantiate(
+            Registry &registry,
+            const std::vector<Entity> &entities
+        ) const = 0;
+    };
+
+    template <typename TComponent>
+    struct PrefabComponent : public IPrefabComponent {
+        TComponent value;
+
+        template <typename... TArgs>
+        PrefabComponent(TArgs &&...args)
+        : value(std::forward<TArgs>(args)...) {}
+
+        void RegisterComponent(ArchetypeStorage &archetypes) const override {
+            if constexpr (!IS_TAG_COMPONENT<TComponent>) {
+                archetypes.RegisterComponent<TComponent>();
+            }
+        }
+        void Instantiate(
+            Registry &registry,
+            const std::vector<Entity> &entities
+        ) const override;
+    };
+
+    // Vector index = component type ID
+    std::vector<std::unique_ptr<IPrefabComponent>> components;
+    Signature signature;
+    // Without tag components, which have no archetype column
+    Signature archetypeSignature;
+    std::vector<int> groupIds;
+
+    friend class Registry;
+
+public:
+    Prefab() = default;
+
+    // Replaces the default value if the prefab already has the component
+    template <typename TComponent, typename... TArgs>
+    Prefab &AddComponent(TArgs &&...args);
+    Prefab &Group(const std::string &group);
+    Prefab &Group(int groupId);
+
+    const Signature &GetSignature() const { return signature; }
+};
+
+template <typename TComponent, typename... TArgs>
+Prefab &Prefab::AddComponent(TArgs &&...args) {
+    const auto componentId = Component<TComponent>::GetId();
+    if (componentId >= static_cast<int>(components.size())) {
+        components.resize(componentId + 1);
+    }
+    components[componentId] = std::make_unique<PrefabComponent<TComponent>>(
+        std::forward<TArgs>(args)...
+    );
+    signature.set(componentId);
+    if constexpr (!IS_TAG_COMPONENT<TComponent>) {
+        archetypeSignature.set(componentId);
+    }
+    return *this;
+}
+
+inline Prefab &Prefab::Group(const std::string &group) {
+    return Group(Registry::GetGroupId(group));
+}
+
+inline Prefab &Prefab::Group(int groupId) {
+    // Checked here so Instantiate cannot fail halfway
+    if (groupId < 0 || groupId >= MAX_GROUPS) {
+        throw std::out_of_range("Invalid group ID");
+    }
+    groupIds.push_back(groupId);
+    return *this;
+}
+
+template <typename TComponent>
+void Prefab::PrefabComponent<TComponent>::Instantiate(
+    Registry &registry,
+    const std::vector<Entity> &entities
+) const {
+    if constexpr (!IS_TAG_COMPONENT<TComponent>) {
+        if (registry.archetypes) {
+            for (const auto &entity : entities) {
+                registry.archetypes->Construct<TComponent>(
+                    entity.GetId(), value
+                );
+            }
+        } else {
+            auto &pool = registry.GetOrCreatePool<TComponent>();
+            pool.Reserve(entities.size());
+            for (const auto &entity : entities) {
+                pool.Emplace(entity.GetId(), value);
+            }
+        }
+    }
+}
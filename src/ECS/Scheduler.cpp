@@ -0,0 +1,54 @@
+#include "Scheduler.h"
+
+Scheduler::Scheduler(ThreadPool &threadPool)
+: threadPool(threadPool) {}
+
+void Scheduler::Add(const System &system, std::function<void()> run) {
+    tasks.push_back({&system, std::move(run), {}, 0});
+}
+
+void Scheduler::Clear() { tasks.clear(); }
+
+void Scheduler::BuildDependencies() {
+    for (auto &task : tasks) {
+        task.successors.clear();
+        task.dependencies = 0;
+    }
+    for (unsigned int i = 0; i < tasks.size(); i++) {
+        for (unsigned int j = i + 1; j < tasks.size(); j++) {
+            if (tasks[i].system->ConflictsWith(*tasks[j].system)) {
+                tasks[i].successors.push_back(j);
+                tasks[j].dependencies += 1;
+            }
+        }
+    }
+}
+
+void Scheduler::Run() {
+    BuildDependencies();
+
+    remainingDependencies = std::make_unique<std::atomic<int>[]>(tasks.size());
+    for (unsigned int i = 0; i < tasks.size(); i++) {
+        remainingDependencies[i] = tasks[i].dependencies;
+    }
+    pendingTasks = tasks.size();
+
+    for (unsigned int i = 0; i < tasks.size(); i++) {
+        if (tasks[i].dependencies == 0) {
+            SubmitTask(i);
+        }
+    }
+    threadPool.Wait(pendingTasks);
+}
+
+void Scheduler::SubmitTask(int task) {
+    threadPool.Submit([this, task] {
+        tasks[task].run();
+        for (const int successor : tasks[task].successors) {
+            if (--remainingDependencies[successor] == 0) {
+                SubmitTask(successor);
+            }
+        }
+        pendingTasks -= 1;
+    });
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "ECS.h"
+#include "ThreadPool.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Runs a frame's systems on a thread pool. Systems are added in their serial
+// order; a system waits for every earlier system it conflicts with according
+// to the declared component reads and writes, and runs in parallel with the
+// rest.
+class Scheduler {
+private:
+    struct Task {
+        const System *system;
+        std::function<void()> run;
+        std::vector<int> successors;
+        int dependencies;
+    };
+
+    ThreadPool &threadPool;
+    std::vector<Task> tasks;
+    std::unique_ptr<std::atomic<int>[]> remainingDependencies;
+    std::atomic<int> pendingTasks;
+
+    void BuildDependencies();
+    void SubmitTask(int task);
+
+public:
+    Scheduler(ThreadPool &threadPool);
+
+    void Add(const System &system, std::function<void()> run);
+    // Runs the added systems and returns once all of them are done
+    void Run();
+    void Clear();
+};
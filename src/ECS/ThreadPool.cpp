@@ -0,0 +1,126 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+thread_local ThreadPool *ThreadPool::currentPool = nullptr;
+thread_local int ThreadPool::currentQueue = 0;
+
+ThreadPool::ThreadPool(unsigned int numWorkers) {
+    for (unsigned int i = 0; i <= numWorkers; i++) {
+        queues.push_back(std::make_unique<WorkQueue>());
+    }
+    for (unsigned int i = 0; i < numWorkers; i++) {
+        workers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        isStopping = true;
+    }
+    jobAvailable.notify_all();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+unsigned int ThreadPool::DefaultWorkerCount() {
+    const unsigned int hardwareThreads = std::thread::hardware_concurrency();
+    return hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+}
+
+int ThreadPool::GetQueueOfCallingThread() const {
+    return currentPool == this ? currentQueue : queues.size() - 1;
+}
+
+void ThreadPool::Submit(std::function<void()> job) {
+    auto &queue = *queues[GetQueueOfCallingThread()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.push_back(std::move(job));
+    }
+    {
+        // Taken so a worker can't miss the wake-up between its check and wait
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        numQueuedJobs += 1;
+    }
+    jobAvailable.notify_one();
+}
+
+bool ThreadPool::PopJob(int queue, std::function<void()> &job) {
+    auto &ownQueue = *queues[queue];
+    std::lock_guard<std::mutex> lock(ownQueue.mutex);
+    if (ownQueue.jobs.empty()) {
+        return false;
+    }
+    job = std::move(ownQueue.jobs.back());
+    ownQueue.jobs.pop_back();
+    return true;
+}
+
+bool ThreadPool::StealJob(int thief, std::function<void()> &job) {
+    const int numQueues = queues.size();
+    for (int i = 1; i < numQueues; i++) {
+        auto &victim = *queues[(thief + i) % numQueues];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.jobs.empty()) {
+            job = std::move(victim.jobs.front());
+            victim.jobs.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPool::RunPendingJob(int queue) {
+    std::function<void()> job;
+    if (!PopJob(queue, job) && !StealJob(queue, job)) {
+        return false;
+    }
+    numQueuedJobs -= 1;
+    job();
+    return true;
+}
+
+void ThreadPool::Wait(const std::atomic<int> &pending) {
+    const int queue = GetQueueOfCallingThread();
+    while (pending.load() > 0) {
+        if (!RunPendingJob(queue)) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void ThreadPool::ParallelFor(
+    int count,
+    int chunkSize,
+    const std::function<void(int, int, int)> &fn
+) {
+    const int numChunks = (count + chunkSize - 1) / chunkSize;
+    std::atomic<int> pendingChunks(numChunks);
+    for (int chunk = 0; chunk < numChunks; chunk++) {
+        Submit([&, chunk] {
+            const int begin = chunk * chunkSize;
+            fn(chunk, begin, std::min(begin + chunkSize, count));
+            pendingChunks -= 1;
+        });
+    }
+    Wait(pendingChunks);
+}
+
+void ThreadPool::WorkerLoop(int queue) {
+    currentPool = this;
+    currentQueue = queue;
+    while (true) {
+        if (RunPendingJob(queue)) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        jobAvailable.wait(lock, [this] {
+            return isStopping || numQueuedJobs > 0;
+        });
+        if (isStopping && numQueuedJobs == 0) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> jobs;
+    };
+
+    std::vector<std::thread> workers;
+    // One queue per worker plus a last one shared by outside threads
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::atomic<int> numQueuedJobs{0};
+    std::mutex sleepMutex;
+    std::condition_variable jobAvailable;
+    bool isStopping = false;
+
+    // Set on worker threads to the pool and queue they own
+    static thread_local ThreadPool *currentPool;
+    static thread_local int currentQueue;
+
+    void WorkerLoop(int queue);
+    int GetQueueOfCallingThread() const;
+    bool PopJob(int queue, std::function<void()> &job);
+    bool StealJob(int thief, std::function<void()> &job);
+    bool RunPendingJob(int queue);
+
+public:
+    // The thread that waits on the pool also runs jobs, so by default one
+    // worker fewer than the hardware thread count is started
+    ThreadPool(unsigned int numWorkers = DefaultWorkerCount());
+    ~ThreadPool();
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // Jobs submitted from a worker go to its own queue, where it picks them
+    // up newest first; idle workers steal the oldest jobs of other queues
+    void Submit(std::function<void()> job);
+    // Runs queued jobs on the calling thread until pending reaches zero
+    void Wait(const std::atomic<int> &pending);
+    // Calls fn(chunk, begin, end) for consecutive ranges of chunkSize items
+    // and returns once every chunk is done
+    void ParallelFor(
+        int count,
+        int chunkSize,
+        const std::function<void(int, int, int)> &fn
+    );
+
+    int GetNumThreads() const { return workers.size() + 1; }
+
+    static unsigned int DefaultWorkerCount();
+};
@@ -0,0 +1,25 @@
+#pragma once
+
+template <typename... Ts> struct TypeList {
+    static constexpr int size = sizeof...(Ts);
+};
+
+// Position of T in TList, or -1 when the list does not contain T
+template <typename T, typename TList> struct TypeIndex;
+
+template <typename T> struct TypeIndex<T, TypeList<>> {
+    static constexpr int value = -1;
+};
+
+template <typename T, typename... Ts> struct TypeIndex<T, TypeList<T, Ts...>> {
+    static constexpr int value = 0;
+};
+
+template <typename T, typename TFirst, typename... Ts>
+struct TypeIndex<T, TypeList<TFirst, Ts...>> {
+private:
+    static constexpr int indexInRest = TypeIndex<T, TypeList<Ts...>>::value;
+
+public:
+    static constexpr int value = indexInRest == -1 ? -1 : indexInRest + 1;
+};
@@ -4,11 +4,13 @@
 #include "Components/CameraFollowComponent.h"
 #include "Components/HealthComponent.h"
 #include "Components/KeyboardControlledComponent.h"
+#include "Components/PositionComponent.h"
 #include "Components/ProjectileEmitterComponent.h"
 #include "Components/RigidBodyComponent.h"
 #include "Components/SpriteComponent.h"
 #include "Components/TextLabelComponent.h"
 #include "Components/TransformComponent.h"
+#include "ECS/Prefab.h"
 #include "Events/EventBus.h"
 #include "Events/KeyPressedEvent.h"
 #include "Logger.h"
@@ -38,6 +40,7 @@
 #include <imgui/imgui_impl_sdlrenderer2.h>
 #include <iostream>
 #include <sstream>
+#include <unordered_map>
 #include <string>
 
 int Game::windowWidth;
@@ -51,6 +54,9 @@ Game::Game() {
     registry = std::make_unique<Registry>();
     assetStore = std::make_unique<AssetStore>();
     eventBus = std::make_unique<EventBus>();
+    threadPool = std::make_unique<ThreadPool>();
+    scheduler = std::make_unique<Scheduler>(*threadPool);
+    registry->SetThreadPool(threadPool.get());
     Logger::Log("Game created");
 }
 
@@ -117,10 +123,13 @@ void Game::LoadLevel(int level) {
     registry->AddSystem<RenderSystem>();
     registry->AddSystem<CollisionSystem>();
     registry->AddSystem<RenderColliderSystem>();
-    registry->AddSystem<DamageSystem>();
+    registry->AddSystem<DamageSystem>(registry->CreateCommandBuffer());
     registry->AddSystem<KeyboardControlSystem>();
     registry->AddSystem<CameraMovementSystem>();
-    registry->AddSystem<ProjectileEmitSystem>();
+    registry->AddSystem<ProjectileEmitSystem>(
+        registry->CreateCommandBuffer(),
+        registry->Share(SpriteComponent("bullet-image", 4, 4, 4))
+    );
     registry->AddSystem<ProjectileLifecycleSystem>();
     registry->AddSystem<RenderTextSystem>();
     registry->AddSystem<RenderHealthSystem>();
@@ -167,25 +176,21 @@ void Game::LoadLevel(int level) {
         const int tileScale = 2;
         const int columns = 25;
         const int rows = 20;
-        int tileX = -1, tileY = -1;
-
-        for (int row = 0; row < rows; row++) {
-            for (int column = 0; column < columns; column++) {
-                char c = mapLayoutStream.get();
-                tileY = c - '0';
-                c = mapLayoutStream.get();
-                tileX = c - '0';
-                mapLayoutStream.ignore();
-                Entity tile = registry->CreateEntity();
-                tile.Group("tiles");
-                tile.AddComponent<TransformComponent>(
-                    glm::vec2(
-                        tileScale * tileSize * column,
-                        tileScale * tileSize * row
-                    ),
-                    glm::vec2(tileScale, tileScale)
-                );
-                tile.AddComponent<SpriteComponent>(
+
+        // Tiles cut from the same part of the tilemap share one sprite
+        std::unordered_map<int, Shared<SpriteComponent>> spritesByTile;
+        std::vector<Shared<SpriteComponent>> tileSprites;
+        tileSprites.reserve(rows * columns);
+        for (int i = 0; i < rows * columns; i++) {
+            char c = mapLayoutStream.get();
+            const int tileY = c - '0';
+            c = mapLayoutStream.get();
+            const int tileX = c - '0';
+            mapLayoutStream.ignore();
+
+            const int tileKey = tileY * 10 + tileX;
+            if (spritesByTile.find(tileKey) == spritesByTile.end()) {
+                SpriteComponent sprite(
                     "tilemap-image",
                     tileSize,
                     tileSize,
@@ -194,17 +199,38 @@ void Game::LoadLevel(int level) {
                     tileSize * tileX,
                     tileSize * tileY
                 );
+                spritesByTile.emplace(tileKey, registry->Share(sprite));
             }
+            tileSprites.push_back(spritesByTile.at(tileKey));
         }
+
+        Prefab tilePrefab;
+        tilePrefab.Group("tiles")
+            .AddComponent<PositionComponent>()
+            .AddComponent<TransformComponent>(glm::vec2(tileScale, tileScale))
+            .AddComponent<Shared<SpriteComponent>>(tileSprites[0]);
+
+        registry->Instantiate(
+            tilePrefab,
+            rows * columns,
+            [&](Entity tile, int index) {
+                const int row = index / columns;
+                const int column = index % columns;
+                tile.GetComponent<PositionComponent>().position = glm::vec2(
+                    tileScale * tileSize * column, tileScale * tileSize * row
+                );
+                tile.GetComponent<Shared<SpriteComponent>>() =
+                    tileSprites[index];
+            }
+        );
         mapWidth = columns * tileSize * tileScale;
         mapHeight = rows * tileSize * tileScale;
     }
 
     Entity chopper = registry->CreateEntity();
     chopper.Tag("player");
-    chopper.AddComponent<TransformComponent>(
-        glm::vec2(240.0, 110.0), glm::vec2(1.0, 1.0), 0.0
-    );
+    chopper.AddComponent<PositionComponent>(glm::vec2(240.0, 110.0));
+    chopper.AddComponent<TransformComponent>(glm::vec2(1.0, 1.0), 0.0);
     chopper.AddComponent<RigidBodyComponent>(glm::vec2(0.0, 0.0));
     chopper.AddComponent<SpriteComponent>("chopper-image", 32, 32, 2);
     chopper.AddComponent<AnimationComponent>(2, 15);
@@ -219,18 +245,16 @@ void Game::LoadLevel(int level) {
     );
 
     Entity radar = registry->CreateEntity();
-    radar.AddComponent<TransformComponent>(
-        glm::vec2(windowWidth - 74.0, 10), glm::vec2(1.0, 1.0), 0.0
-    );
+    radar.AddComponent<PositionComponent>(glm::vec2(windowWidth - 74.0, 10));
+    radar.AddComponent<TransformComponent>(glm::vec2(1.0, 1.0), 0.0);
     radar.AddComponent<RigidBodyComponent>(glm::vec2(0.0, 0.0));
     radar.AddComponent<SpriteComponent>("radar-image", 64, 64, 2, true);
     radar.AddComponent<AnimationComponent>(8, 5);
 
     Entity tank = registry->CreateEntity();
     tank.Group("enemies");
-    tank.AddComponent<TransformComponent>(
-        glm::vec2(500.0, 500.0), glm::vec2(1.0, 1.0), 0.0
-    );
+    tank.AddComponent<PositionComponent>(glm::vec2(500.0, 500.0));
+    tank.AddComponent<TransformComponent>(glm::vec2(1.0, 1.0), 0.0);
     tank.AddComponent<RigidBodyComponent>(glm::vec2(20.0, 0.0));
     tank.AddComponent<SpriteComponent>("tank-image", 32, 32, 1);
     tank.AddComponent<BoxColliderComponent>(32, 32);
@@ -241,9 +265,8 @@ void Game::LoadLevel(int level) {
 
     Entity truck = registry->CreateEntity();
     truck.Group("enemies");
-    truck.AddComponent<TransformComponent>(
-        glm::vec2(120.0, 500.0), glm::vec2(1.0, 1.0), 0.0
-    );
+    truck.AddComponent<PositionComponent>(glm::vec2(120.0, 500.0));
+    truck.AddComponent<TransformComponent>(glm::vec2(1.0, 1.0), 0.0);
     truck.AddComponent<RigidBodyComponent>(glm::vec2(0.0, 0.0));
     truck.AddComponent<SpriteComponent>("truck-image", 32, 32, 2);
     truck.AddComponent<BoxColliderComponent>(32, 32);
@@ -252,21 +275,17 @@ void Game::LoadLevel(int level) {
     );
     truck.AddComponent<HealthComponent>(100);
 
-    Entity treeA = registry->CreateEntity();
-    treeA.Group("obstacles");
-    treeA.AddComponent<TransformComponent>(
-        glm::vec2(600.0, 495.0), glm::vec2(1.0, 1.0), 0.0
-    );
-    treeA.AddComponent<SpriteComponent>("tree-image", 16, 32, 2);
-    treeA.AddComponent<BoxColliderComponent>(16, 32);
+    Prefab treePrefab;
+    treePrefab.Group("obstacles")
+        .AddComponent<PositionComponent>()
+        .AddComponent<TransformComponent>()
+        .AddComponent<SpriteComponent>("tree-image", 16, 32, 2)
+        .AddComponent<BoxColliderComponent>(16, 32);
 
-    Entity treeB = registry->CreateEntity();
-    treeB.Group("obstacles");
-    treeB.AddComponent<TransformComponent>(
-        glm::vec2(400.0, 495.0), glm::vec2(1.0, 1.0), 0.0
-    );
-    treeB.AddComponent<SpriteComponent>("tree-image", 16, 32, 2);
-    treeB.AddComponent<BoxColliderComponent>(16, 32);
+    const glm::vec2 treePositions[] = {{600.0, 495.0}, {400.0, 495.0}};
+    registry->Instantiate(treePrefab, 2, [&](Entity tree, int index) {
+        tree.GetComponent<PositionComponent>().position = treePositions[index];
+    });
 
     Entity gameName = registry->CreateEntity();
     SDL_Color green = {0, 255, 0};
@@ -298,26 +317,58 @@ void Game::Update() {
 
     // update systems
     registry->Update();
-    registry->GetSystem<MovementSystem>().Update(deltaTime);
-    registry->GetSystem<AnimationSystem>().Update();
-    registry->GetSystem<CollisionSystem>().Update(*eventBus);
-    registry->GetSystem<CameraMovementSystem>().Update(camera);
-    registry->GetSystem<ProjectileEmitSystem>().Update(*registry);
-    registry->GetSystem<ProjectileLifecycleSystem>().Update();
+
+    // systems that touch disjoint components run in parallel, the rest keep
+    // the order they are added in
+    auto &movementSystem = registry->GetSystem<MovementSystem>();
+    auto &animationSystem = registry->GetSystem<AnimationSystem>();
+    auto &collisionSystem = registry->GetSystem<CollisionSystem>();
+    auto &cameraMovementSystem = registry->GetSystem<CameraMovementSystem>();
+    auto &projectileEmitSystem = registry->GetSystem<ProjectileEmitSystem>();
+    auto &projectileLifecycleSystem =
+        registry->GetSystem<ProjectileLifecycleSystem>();
+
+    scheduler->Clear();
+    scheduler->Add(movementSystem, [&] {
+        movementSystem.Update(deltaTime, *registry);
+    });
+    scheduler->Add(animationSystem, [&] { animationSystem.Update(); });
+    scheduler->Add(collisionSystem, [&] {
+        collisionSystem.Update(*registry, *eventBus);
+    });
+    scheduler->Add(cameraMovementSystem, [&] {
+        cameraMovementSystem.Update(camera);
+    });
+    scheduler->Add(projectileEmitSystem, [&] {
+        projectileEmitSystem.Update();
+    });
+    scheduler->Add(projectileLifecycleSystem, [&] {
+        projectileLifecycleSystem.Update();
+    });
+    scheduler->Run();
+
+    // release memory left behind by waves of dead entities, a bit per frame
+    registry->Compact(
+        std::chrono::microseconds(COMPACTION_MICROSECS_PER_FRAME)
+    );
 }
 
 void Game::Render() {
     SDL_SetRenderDrawColor(renderer, 21, 21, 21, 255);
     SDL_RenderClear(renderer);
-    registry->GetSystem<RenderSystem>().Update(renderer, *assetStore, camera);
+    registry->GetSystem<RenderSystem>().Update(
+        renderer, *assetStore, camera, *registry
+    );
     registry->GetSystem<RenderHealthSystem>().Update(
-        renderer, *assetStore, camera
+        renderer, *assetStore, camera, *registry
     );
     registry->GetSystem<RenderTextSystem>().Update(
         renderer, *assetStore, camera
     );
     if (isDebug) {
-        registry->GetSystem<RenderColliderSystem>().Update(renderer, camera);
+        registry->GetSystem<RenderColliderSystem>().Update(
+            renderer, camera, *registry
+        );
         registry->GetSystem<RenderGUISystem>().Update(renderer, *registry);
     }
     SDL_RenderPresent(renderer);
@@ -360,6 +411,8 @@ void Game::Destroy() {
     ImGui_ImplSDLRenderer2_Shutdown();
     ImGui_ImplSDL2_Shutdown();
     ImGui::DestroyContext();
+    // Systems own textures, which must be freed before the renderer
+    registry.reset();
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     SDL_Quit();
@@ -2,12 +2,15 @@
 
 #include "AssetStore/AssetStore.h"
 #include "ECS/ECS.h"
+#include "ECS/Scheduler.h"
+#include "ECS/ThreadPool.h"
 #include "Events/EventBus.h"
 #include <SDL2/SDL.h>
 #include <memory>
 
 constexpr int FPS = 400;
 constexpr int MILLISECS_PER_FRAME = 1000 / FPS;
+constexpr int COMPACTION_MICROSECS_PER_FRAME = 200;
 
 class Game {
 private:
@@ -20,6 +23,8 @@ private:
     std::unique_ptr<Registry> registry;
     std::unique_ptr<AssetStore> assetStore;
     std::unique_ptr<EventBus> eventBus;
+    std::unique_ptr<ThreadPool> threadPool;
+    std::unique_ptr<Scheduler> scheduler;
 
 public:
     Game();
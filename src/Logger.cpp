@@ -1,14 +1,20 @@
 #include "Logger.h"
 #include <iostream>
+#include <mutex>
 
 std::vector<LogEntry> Logger::messages;
 
+// Systems may log from worker threads
+static std::mutex messagesMutex;
+
 void Logger::Log(const std::string &message) {
+    std::lock_guard<std::mutex> lock(messagesMutex);
     std::cerr << "[LOG] " << message << '\n';
     messages.emplace_back(LOG_INFO, message);
 }
 
 void Logger::Err(const std::string &message) {
+    std::lock_guard<std::mutex> lock(messagesMutex);
     std::cerr << "[ERR] " << message << '\n';
     messages.emplace_back(LOG_ERROR, message);
 }
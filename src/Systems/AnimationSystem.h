@@ -6,21 +6,34 @@
 #include <SDL2/SDL.h>
 
 class AnimationSystem : public System {
+private:
+    static constexpr int ENTITIES_PER_JOB = 1024;
+
 public:
     AnimationSystem() {
         RequireComponent<AnimationComponent>();
         RequireComponent<SpriteComponent>();
+        WritesComponent<AnimationComponent>();
+        WritesComponent<SpriteComponent>();
     }
 
     void Update() {
-        for (auto &entity : GetSystemEntities()) {
+        const Uint32 ticks = SDL_GetTicks();
+        ParallelForEach(ENTITIES_PER_JOB, [ticks](Entity entity) {
             auto& animation = entity.GetComponent<AnimationComponent>();
             auto& sprite = entity.GetComponent<SpriteComponent>();
 
-            animation.currentFrame = ((SDL_GetTicks() - animation.startTime) *
-                                      animation.frameSpeedRate / 1000) %
-                                     animation.numFrames;
+            const int frame = ((ticks - animation.startTime) *
+                               animation.frameSpeedRate / 1000) %
+                              animation.numFrames;
+            if (frame == animation.currentFrame &&
+                sprite.srcRect.x == frame * sprite.width) {
+                return;
+            }
+            animation.currentFrame = frame;
             sprite.srcRect.x = animation.currentFrame * sprite.width;
-        }
+            entity.MarkChanged<AnimationComponent>();
+            entity.MarkChanged<SpriteComponent>();
+        });
     }
 };
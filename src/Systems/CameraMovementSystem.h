@@ -3,25 +3,27 @@
 #include "../Game.h"
 #include "../ECS/ECS.h"
 #include "../Components/CameraFollowComponent.h"
-#include "../Components/TransformComponent.h"
+#include "../Components/PositionComponent.h"
 #include <SDL2/SDL.h>
 
 class CameraMovementSystem : public System {
 public:
     CameraMovementSystem() {
         RequireComponent<CameraFollowComponent>();
-        RequireComponent<TransformComponent>();
+        RequireComponent<PositionComponent>();
+        ReadsComponent<CameraFollowComponent>();
+        ReadsComponent<PositionComponent>();
     }
 
     void Update(SDL_Rect &camera) {
         for (auto &entity : GetSystemEntities()) {
-            auto &transform = entity.GetComponent<TransformComponent>();
+            auto &position = entity.GetComponent<PositionComponent>().position;
 
-            if (transform.position.x + (camera.w / 2) < Game::mapWidth) {
-                camera.x = transform.position.x - (Game::windowWidth / 2);
+            if (position.x + (camera.w / 2) < Game::mapWidth) {
+                camera.x = position.x - (Game::windowWidth / 2);
             }
-            if (transform.position.y + (camera.h / 2) < Game::mapHeight) {
-                camera.y = transform.position.y - (Game::windowHeight / 2);
+            if (position.y + (camera.h / 2) < Game::mapHeight) {
+                camera.y = position.y - (Game::windowHeight / 2);
             }
 
             camera.x = camera.x < 0 ? 0 : camera.x;
@@ -1,51 +1,75 @@
 #pragma once
 
 #include "../Components/BoxColliderComponent.h"
-#include "../Components/TransformComponent.h"
+#include "../Components/HealthComponent.h"
+#include "../Components/PositionComponent.h"
+#include "../Components/ProjectileComponent.h"
+#include "../Components/ProjectileEmitterComponent.h"
+#include "../Components/RigidBodyComponent.h"
+#include "../Components/SpriteComponent.h"
 #include "../ECS/ECS.h"
 #include "../Events/CollisionEvent.h"
 #include "../Events/EventBus.h"
+#include <vector>
 
 class CollisionSystem : public System {
 public:
     CollisionSystem() {
-        RequireComponent<TransformComponent>();
+        RequireComponent<PositionComponent>();
         RequireComponent<BoxColliderComponent>();
+        ReadsComponent<PositionComponent>();
+        ReadsComponent<BoxColliderComponent>();
+        // Collision events are handled inline by the damage and movement
+        // systems, so their component access is declared here as well
+        ReadsComponent<ProjectileComponent>();
+        WritesComponent<HealthComponent>();
+        WritesComponent<RigidBodyComponent>();
+        WritesComponent<SpriteComponent>();
+        WritesComponent<ProjectileEmitterComponent>();
     }
 
-    void Update(EventBus &eventBus) {
-        auto &entities = GetSystemEntities();
-        for (auto i = entities.begin(); i != entities.end(); i++) {
-            Entity a = *i;
-            auto &aTransform = a.GetComponent<TransformComponent>();
-            auto &aCollider = a.GetComponent<BoxColliderComponent>();
+    void Update(Registry &registry, EventBus &eventBus) {
+        colliders.clear();
+        registry.View<PositionComponent, BoxColliderComponent>().Each(
+            [this](
+                Entity entity,
+                PositionComponent &position,
+                BoxColliderComponent &collider
+            ) { colliders.push_back({entity, &position, &collider}); }
+        );
 
-            for (auto j = i; j != entities.end(); j++) {
-                Entity b = *j;
-                if (a == b) {
-                    continue;
-                }
+        for (auto i = colliders.begin(); i != colliders.end(); i++) {
+            const auto &aPosition = i->position->position;
+            const auto &aCollider = *i->collider;
 
-                auto &bTransform = b.GetComponent<TransformComponent>();
-                auto &bCollider = b.GetComponent<BoxColliderComponent>();
+            for (auto j = i + 1; j != colliders.end(); j++) {
+                const auto &bPosition = j->position->position;
+                const auto &bCollider = *j->collider;
                 bool collided = AABBCollision(
-                    aTransform.position.x + aCollider.offset.x,
-                    aTransform.position.y + aCollider.offset.y,
+                    aPosition.x + aCollider.offset.x,
+                    aPosition.y + aCollider.offset.y,
                     aCollider.width,
                     aCollider.height,
-                    bTransform.position.x + bCollider.offset.x,
-                    bTransform.position.y + bCollider.offset.y,
+                    bPosition.x + bCollider.offset.x,
+                    bPosition.y + bCollider.offset.y,
                     bCollider.width,
                     bCollider.height
                 );
                 if (collided) {
-                    eventBus.EmitEvent<CollisionEvent>(a, b);
+                    eventBus.EmitEvent<CollisionEvent>(i->entity, j->entity);
                 }
             }
         }
     }
 
 private:
+    struct Collider {
+        Entity entity;
+        const PositionComponent *position;
+        const BoxColliderComponent *collider;
+    };
+    std::vector<Collider> colliders;
+
     bool AABBCollision(
         double aX,
         double aY,
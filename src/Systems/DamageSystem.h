@@ -3,13 +3,23 @@
 #include "../Components/BoxColliderComponent.h"
 #include "../Components/HealthComponent.h"
 #include "../Components/ProjectileComponent.h"
+#include "../ECS/CommandBuffer.h"
 #include "../ECS/ECS.h"
 #include "../Events/CollisionEvent.h"
 #include "../Events/EventBus.h"
 
 class DamageSystem : public System {
+private:
+    const int playerTag = Registry::GetTagId("player");
+    const int projectilesGroup = Registry::GetGroupId("projectiles");
+    const int enemiesGroup = Registry::GetGroupId("enemies");
+    // Collision events arrive while the collision system is iterating
+    CommandBuffer &commands;
+
 public:
-    DamageSystem() { RequireComponent<BoxColliderComponent>(); }
+    DamageSystem(CommandBuffer &commands) : commands(commands) {
+        RequireComponent<BoxColliderComponent>();
+    }
 
     void SubscribeToEvents(EventBus &eventBus) {
         eventBus.SubscribeToEvent<CollisionEvent>(
@@ -21,16 +31,18 @@ public:
         Entity a = event.a;
         Entity b = event.b;
 
-        if (a.BelongsToGroup("projectiles") && b.HasTag("player")) {
+        if (a.BelongsToGroup(projectilesGroup) && b.HasTag(playerTag)) {
             OnProjectileHitsPlayer(a, b);
         }
-        if (b.BelongsToGroup("projectiles") && a.HasTag("player")) {
+        if (b.BelongsToGroup(projectilesGroup) && a.HasTag(playerTag)) {
             OnProjectileHitsPlayer(b, a);
         }
-        if (a.BelongsToGroup("projectiles") && b.BelongsToGroup("enemies")) {
+        if (a.BelongsToGroup(projectilesGroup) &&
+            b.BelongsToGroup(enemiesGroup)) {
             OnProjectileHitsEnemy(a, b);
         }
-        if (b.BelongsToGroup("projectiles") && a.BelongsToGroup("enemies")) {
+        if (b.BelongsToGroup(projectilesGroup) &&
+            a.BelongsToGroup(enemiesGroup)) {
             OnProjectileHitsEnemy(b, a);
         }
     }
@@ -42,14 +54,14 @@ public:
             return;
         }
 
-        auto &health = player.GetComponent<HealthComponent>();
+        auto &health = player.Patch<HealthComponent>();
         health.healthPercentage -= projectileComponent.hitPercentageDamage;
 
         if (health.healthPercentage <= 0) {
-            player.Kill();
+            commands.Kill(player);
         }
 
-        projectile.Kill();
+        commands.Kill(projectile);
     }
 
     void OnProjectileHitsEnemy(Entity projectile, Entity enemy) {
@@ -59,14 +71,14 @@ public:
             return;
         }
 
-        auto &health = enemy.GetComponent<HealthComponent>();
+        auto &health = enemy.Patch<HealthComponent>();
         health.healthPercentage -= projectileComponent.hitPercentageDamage;
 
         if (health.healthPercentage <= 0) {
-            enemy.Kill();
+            commands.Kill(enemy);
         }
 
-        projectile.Kill();
+        commands.Kill(projectile);
     }
 
     void Update() {}
@@ -47,7 +47,11 @@ public:
                 body.velocity = keyboard.leftVelocity;
                 sprite.srcRect.y = sprite.height * 3;
                 break;
+            default:
+                continue;
             }
+            entity.MarkChanged<SpriteComponent>();
+            entity.MarkChanged<RigidBodyComponent>();
         }
     }
 
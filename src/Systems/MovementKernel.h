@@ -0,0 +1,168 @@
+#pragma once
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define MOVEMENT_KERNEL_X86_64
+#endif
+
+// Integrate-and-bounds kernel of MovementSystem. Positions and velocities
+// are packed x, y pairs, as laid out in their component pools. Each kernel
+// moves the entities from begin to end by velocity times deltaTime, and
+// writes the indices of the ones that end up outside [0, width] x
+// [0, height] to outside, in ascending order. They return how many were
+// written; outside needs room for one index per entity.
+namespace MovementKernel {
+
+inline int IntegrateScalar(
+    float *positions,
+    const float *velocities,
+    int begin,
+    int end,
+    float deltaTime,
+    float width,
+    float height,
+    int *outside
+) {
+    int numOutside = 0;
+    for (int i = begin; i < end; i++) {
+        float &x = positions[2 * i];
+        float &y = positions[2 * i + 1];
+        x += velocities[2 * i] * deltaTime;
+        y += velocities[2 * i + 1] * deltaTime;
+        if (!(x >= 0 && x <= width && y >= 0 && y <= height)) {
+            outside[numOutside++] = i;
+        }
+    }
+    return numOutside;
+}
+
+#ifdef MOVEMENT_KERNEL_X86_64
+// The compare mask has an x and a y bit per entity, starting with the
+// entity at index first. Entities with either bit clear are outside.
+inline int WriteOutside(int insideMask, int first, int *outside) {
+    int numOutside = 0;
+    int outsideMask = ~insideMask;
+    outsideMask = (outsideMask | outsideMask >> 1) & 0x55;
+    for (; outsideMask != 0; outsideMask &= outsideMask - 1) {
+        outside[numOutside++] = first + __builtin_ctz(outsideMask) / 2;
+    }
+    return numOutside;
+}
+
+// Two entities per vector. NaN compares false, so it counts as outside as
+// in the scalar loop.
+inline int IntegrateSse(
+    float *positions,
+    const float *velocities,
+    int begin,
+    int end,
+    float deltaTime,
+    float width,
+    float height,
+    int *outside
+) {
+    const __m128 dt = _mm_set1_ps(deltaTime);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 bounds = _mm_setr_ps(width, height, width, height);
+    int numOutside = 0;
+    int i = begin;
+    for (; i + 2 <= end; i += 2) {
+        const __m128 position = _mm_add_ps(
+            _mm_loadu_ps(positions + 2 * i),
+            _mm_mul_ps(_mm_loadu_ps(velocities + 2 * i), dt)
+        );
+        _mm_storeu_ps(positions + 2 * i, position);
+        const __m128 inside = _mm_and_ps(
+            _mm_cmpge_ps(position, zero), _mm_cmple_ps(position, bounds)
+        );
+        // Only the low four bits belong to these two entities
+        numOutside += WriteOutside(
+            _mm_movemask_ps(inside) | ~0xF, i, outside + numOutside
+        );
+    }
+    return numOutside + IntegrateScalar(
+                            positions,
+                            velocities,
+                            i,
+                            end,
+                            deltaTime,
+                            width,
+                            height,
+                            outside + numOutside
+                        );
+}
+
+// Four entities per vector
+__attribute__((target("avx"))) inline int IntegrateAvx(
+    float *positions,
+    const float *velocities,
+    int begin,
+    int end,
+    float deltaTime,
+    float width,
+    float height,
+    int *outside
+) {
+    const __m256 dt = _mm256_set1_ps(deltaTime);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 bounds = _mm256_setr_ps(
+        width, height, width, height, width, height, width, height
+    );
+    int numOutside = 0;
+    int i = begin;
+    for (; i + 4 <= end; i += 4) {
+        const __m256 position = _mm256_add_ps(
+            _mm256_loadu_ps(positions + 2 * i),
+            _mm256_mul_ps(_mm256_loadu_ps(velocities + 2 * i), dt)
+        );
+        _mm256_storeu_ps(positions + 2 * i, position);
+        const __m256 inside = _mm256_and_ps(
+            _mm256_cmp_ps(position, zero, _CMP_GE_OQ),
+            _mm256_cmp_ps(position, bounds, _CMP_LE_OQ)
+        );
+        numOutside += WriteOutside(
+            _mm256_movemask_ps(inside), i, outside + numOutside
+        );
+    }
+    return numOutside + IntegrateSse(
+                            positions,
+                            velocities,
+                            i,
+                            end,
+                            deltaTime,
+                            width,
+                            height,
+                            outside + numOutside
+                        );
+}
+#endif
+
+// Picks the widest kernel the CPU runs. SSE2 is part of x86-64; AVX is
+// checked once at run time, so the default build uses it too.
+inline int Integrate(
+    float *positions,
+    const float *velocities,
+    int count,
+    float deltaTime,
+    float width,
+    float height,
+    int *outside
+) {
+#ifdef MOVEMENT_KERNEL_X86_64
+    static const bool hasAvx = __builtin_cpu_supports("avx");
+    if (hasAvx) {
+        return IntegrateAvx(
+            positions, velocities, 0, count, deltaTime, width, height, outside
+        );
+    }
+    return IntegrateSse(
+        positions, velocities, 0, count, deltaTime, width, height, outside
+    );
+#else
+    return IntegrateScalar(
+        positions, velocities, 0, count, deltaTime, width, height, outside
+    );
+#endif
+}
+
+} // namespace MovementKernel
@@ -1,22 +1,48 @@
 #pragma once
 
+#include "../Components/PositionComponent.h"
 #include "../Components/ProjectileEmitterComponent.h"
 #include "../Components/RigidBodyComponent.h"
 #include "../Components/SpriteComponent.h"
-#include "../Components/TransformComponent.h"
 #include "../ECS/ECS.h"
 #include "../Events/CollisionEvent.h"
 #include "../Events/EventBus.h"
 #include "../Game.h"
 #include "../Logger.h"
+#include "MovementKernel.h"
 #include <SDL2/SDL_render.h>
 #include <algorithm>
+#include <vector>
 
 class MovementSystem : public System {
+private:
+    static constexpr int ENTITIES_PER_JOB = 1024;
+    static constexpr int PAGE_SIZE = Pool<PositionComponent>::PAGE_SIZE;
+    static_assert(sizeof(PositionComponent) == 2 * sizeof(float));
+    static_assert(sizeof(RigidBodyComponent) == 2 * sizeof(float));
+
+    const int playerTag = Registry::GetTagId("player");
+    const int enemiesGroup = Registry::GetGroupId("enemies");
+    const int obstaclesGroup = Registry::GetGroupId("obstacles");
+
+    // Pointers of one chunk of entities, for archetype storage
+    struct MovementBatch {
+        std::vector<PositionComponent *> positions;
+        std::vector<RigidBodyComponent *> rigidBodies;
+
+        void Resize(int count) {
+            positions.resize(count);
+            rigidBodies.resize(count);
+        }
+    };
+
 public:
     MovementSystem() {
-        RequireComponent<TransformComponent>();
+        RequireComponent<PositionComponent>();
         RequireComponent<RigidBodyComponent>();
+        WritesComponent<PositionComponent>();
+        // Update reorders its pool as well
+        WritesComponent<RigidBodyComponent>();
     }
 
     void SubscribeToEvents(EventBus &eventBus) {
@@ -25,83 +51,149 @@ public:
         );
     }
 
-    void Update(double deltaTime) {
-        for (auto entity : GetSystemEntities()) {
-            auto &transform = entity.GetComponent<TransformComponent>();
-            const auto &rigidBody = entity.GetComponent<RigidBodyComponent>();
-
-            transform.position.x += rigidBody.velocity.x * deltaTime;
-            transform.position.y += rigidBody.velocity.y * deltaTime;
-
-            bool isEntityOutsideMap =
-                (transform.position.x < 0 ||
-                 transform.position.x > Game::mapWidth ||
-                 transform.position.y < 0 ||
-                 transform.position.y > Game::mapHeight);
-            if (isEntityOutsideMap) {
-                if (entity.HasTag("player")) {
-                    transform.position.x = std::clamp(
-                        transform.position.x,
-                        0.0f,
-                        static_cast<float>(Game::mapWidth)
-                    );
-                    transform.position.y = std::clamp(
-                        transform.position.y,
-                        0.0f,
-                        static_cast<float>(Game::mapHeight)
+    // Both pools are put in system entity order first, so the positions and
+    // velocities of a chunk are two packed columns the kernel runs down.
+    // Only the entities the kernel reports outside the map are looked at
+    // one by one.
+    void Update(double deltaTime, Registry &registry) {
+        const auto &entities = GetSystemEntities();
+        if (entities.empty()) {
+            return;
+        }
+        const int playerId = registry.TagExists(playerTag)
+                                 ? registry.GetEntityByTag(playerTag).GetId()
+                                 : -1;
+        const float dt = deltaTime;
+        const float mapWidth = Game::mapWidth;
+        const float mapHeight = Game::mapHeight;
+
+        const auto leaveMap = [&](Entity entity, glm::vec2 &position) {
+            if (entity.GetId() == playerId) {
+                position.x = std::clamp(position.x, 0.0f, mapWidth);
+                position.y = std::clamp(position.y, 0.0f, mapHeight);
+            } else {
+                entity.Kill();
+            }
+        };
+
+        if (!registry.SortAs<PositionComponent>(entities) ||
+            !registry.SortAs<RigidBodyComponent>(entities)) {
+            // Archetype storage keeps its own order, so each entity is a
+            // column of one
+            ParallelForChunks(ENTITIES_PER_JOB, [&](int begin, int end) {
+                static thread_local MovementBatch batch;
+                const int count = end - begin;
+                batch.Resize(count);
+                registry.GetComponents(
+                    &entities[begin], count, batch.positions.data()
+                );
+                registry.GetComponents(
+                    &entities[begin], count, batch.rigidBodies.data()
+                );
+                for (int i = 0; i < count; i++) {
+                    auto &position = batch.positions[i]->position;
+                    int outside;
+                    if (MovementKernel::Integrate(
+                            &position.x,
+                            &batch.rigidBodies[i]->velocity.x,
+                            1,
+                            dt,
+                            mapWidth,
+                            mapHeight,
+                            &outside
+                        ) != 0) {
+                        leaveMap(entities[begin + i], position);
+                    }
+                }
+            });
+            return;
+        }
+
+        auto &positions = registry.GetPool<PositionComponent>();
+        auto &rigidBodies = registry.GetPool<RigidBodyComponent>();
+        ParallelForChunks(ENTITIES_PER_JOB, [&](int begin, int end) {
+            static thread_local std::vector<int> outside;
+            // Columns are contiguous up to the end of a pool page
+            for (int first = begin; first < end;) {
+                const int last =
+                    std::min(end, (first / PAGE_SIZE + 1) * PAGE_SIZE);
+                const int count = last - first;
+                auto *position = &positions[first];
+                const auto *rigidBody = &rigidBodies[first];
+
+                outside.resize(count);
+                const int numOutside = MovementKernel::Integrate(
+                    &position->position.x,
+                    &rigidBody->velocity.x,
+                    count,
+                    dt,
+                    mapWidth,
+                    mapHeight,
+                    outside.data()
+                );
+                positions.MarkChangedWhere(first, count, [&](int i) {
+                    const auto &velocity = rigidBody[i].velocity;
+                    return velocity.x != 0 || velocity.y != 0;
+                });
+                for (int i = 0; i < numOutside; i++) {
+                    const int index = outside[i];
+                    leaveMap(
+                        entities[first + index], position[index].position
                     );
-                } else {
-                    entity.Kill();
                 }
+                first = last;
             }
-        }
+        });
     }
 
     void OnCollision(CollisionEvent &event) {
         Entity &a = event.a;
         Entity &b = event.b;
 
-        if (a.BelongsToGroup("enemies") && b.BelongsToGroup("obstacles")) {
+        if (a.BelongsToGroup(enemiesGroup) &&
+            b.BelongsToGroup(obstaclesGroup)) {
             Logger::Log("Bounce! a -> b");
             OnEnemyHitsObstacle(a, b);
         }
-        if (a.BelongsToGroup("obstacles") && b.BelongsToGroup("enemies")) {
+        if (a.BelongsToGroup(obstaclesGroup) &&
+            b.BelongsToGroup(enemiesGroup)) {
             Logger::Log("Bounce! b -> a");
             OnEnemyHitsObstacle(b, a);
         }
     }
 
     void OnEnemyHitsObstacle(Entity &enemy, Entity &obstacle) {
-        if (enemy.HasComponent<RigidBodyComponent>()) {
-            auto &rigidBody = enemy.GetComponent<RigidBodyComponent>();
-            bool flipVelocityX = rigidBody.velocity.x != 0;
-            bool flipVelocityY = rigidBody.velocity.y != 0;
+        auto *rigidBody = enemy.TryGetComponent<RigidBodyComponent>();
+        if (!rigidBody) {
+            return;
+        }
+        bool flipVelocityX = rigidBody->velocity.x != 0;
+        bool flipVelocityY = rigidBody->velocity.y != 0;
 
+        if (flipVelocityX) {
+            rigidBody->velocity.x *= -1;
+        }
+        if (flipVelocityY) {
+            rigidBody->velocity.y *= -1;
+        }
+        enemy.MarkChanged<RigidBodyComponent>();
+
+        auto *sprite = enemy.TryGetComponent<SpriteComponent>();
+        if (sprite && flipVelocityX) {
+            sprite->flip = (sprite->flip == SDL_FLIP_NONE)
+                               ? SDL_FLIP_HORIZONTAL
+                               : SDL_FLIP_NONE;
+            enemy.MarkChanged<SpriteComponent>();
+        }
+        auto *emitter = enemy.TryGetComponent<ProjectileEmitterComponent>();
+        if (emitter) {
             if (flipVelocityX) {
-                rigidBody.velocity.x *= -1;
+                emitter->projectileVelocity.x *= -1;
             }
             if (flipVelocityY) {
-                rigidBody.velocity.y *= -1;
-            }
-
-            if (enemy.HasComponent<SpriteComponent>()) {
-                auto &sprite = enemy.GetComponent<SpriteComponent>();
-                if (flipVelocityX) {
-                    sprite.flip = (sprite.flip == SDL_FLIP_NONE)
-                                      ? SDL_FLIP_HORIZONTAL
-                                      : SDL_FLIP_NONE;
-                }
-            }
-            if (enemy.HasComponent<ProjectileEmitterComponent>()) {
-                auto &emitter =
-                    enemy.GetComponent<ProjectileEmitterComponent>();
-                if (flipVelocityX) {
-                    emitter.projectileVelocity.x *= -1;
-                }
-                if (flipVelocityY) {
-                    emitter.projectileVelocity.y *= -1;
-                }
+                emitter->projectileVelocity.y *= -1;
             }
+            enemy.MarkChanged<ProjectileEmitterComponent>();
         }
     }
 };
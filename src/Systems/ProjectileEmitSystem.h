@@ -1,22 +1,48 @@
 #pragma once
 
 #include "../Components/BoxColliderComponent.h"
+#include "../Components/PositionComponent.h"
 #include "../Components/ProjectileComponent.h"
 #include "../Components/ProjectileEmitterComponent.h"
 #include "../Components/RigidBodyComponent.h"
 #include "../Components/SpriteComponent.h"
 #include "../Components/TransformComponent.h"
+#include "../ECS/CommandBuffer.h"
 #include "../ECS/ECS.h"
+#include "../ECS/Prefab.h"
 #include "../Events/EventBus.h"
 #include "../Events/KeyPressedEvent.h"
 #include <SDL2/SDL.h>
 #include <glm/glm.hpp>
 
 class ProjectileEmitSystem : public System {
+private:
+    const int projectilesGroup = Registry::GetGroupId("projectiles");
+    // Projectiles are created on playback, so emitting can run alongside
+    // systems that iterate the pools
+    CommandBuffer &commands;
+    // Parts shared by every projectile
+    Prefab projectilePrefab;
+
 public:
-    ProjectileEmitSystem() {
+    ProjectileEmitSystem(
+        CommandBuffer &commands,
+        Shared<SpriteComponent> projectileSprite
+    )
+    : commands(commands) {
         RequireComponent<ProjectileEmitterComponent>();
+        RequireComponent<PositionComponent>();
         RequireComponent<TransformComponent>();
+        ReadsComponent<PositionComponent>();
+        ReadsComponent<TransformComponent>();
+        ReadsComponent<SpriteComponent>();
+        ReadsComponent<RigidBodyComponent>();
+        WritesComponent<ProjectileEmitterComponent>();
+
+        projectilePrefab.Group(projectilesGroup)
+            .AddComponent<Shared<SpriteComponent>>(projectileSprite)
+            .AddComponent<TransformComponent>(glm::vec2(2.0, 2.0), 0.0)
+            .AddComponent<BoxColliderComponent>(4, 4);
     }
 
     void SubscribeToEvents(EventBus &eventBus) {
@@ -33,6 +59,8 @@ public:
         for (auto &entity : GetSystemEntities()) {
             auto &projectileEmitter =
                 entity.GetComponent<ProjectileEmitterComponent>();
+            const auto &position =
+                entity.GetComponent<PositionComponent>().position;
             const auto &transform = entity.GetComponent<TransformComponent>();
 
             if (!projectileEmitter.isFriendly) {
@@ -41,54 +69,54 @@ public:
 
             if (SDL_GetTicks() - projectileEmitter.lastEmissionTime >
                 projectileEmitter.repeatFrequency) {
-                glm::vec2 projectilePosition = transform.position;
-                if (entity.HasComponent<SpriteComponent>()) {
-                    const auto &sprite = entity.GetComponent<SpriteComponent>();
+                glm::vec2 projectilePosition = position;
+                if (const auto *sprite =
+                        entity.TryGetComponent<SpriteComponent>()) {
                     projectilePosition.x +=
-                        transform.scale.x * sprite.width / 2;
+                        transform.scale.x * sprite->width / 2;
                     projectilePosition.y +=
-                        transform.scale.y * sprite.height / 2;
+                        transform.scale.y * sprite->height / 2;
                 }
 
-                Entity projectile = entity.registry->CreateEntity();
-                projectile.Group("projectiles");
-                projectile.AddComponent<TransformComponent>(
-                    projectilePosition, glm::vec2(2.0, 2.0), 0.0
+                const auto projectile = commands.Instantiate(projectilePrefab);
+                commands.AddComponent<PositionComponent>(
+                    projectile, projectilePosition
                 );
                 auto projectileVelocity = projectileEmitter.projectileVelocity;
-                if (entity.HasComponent<RigidBodyComponent>()) {
-                    const auto &rigidBody =
-                        entity.GetComponent<RigidBodyComponent>();
+                if (const auto *rigidBody =
+                        entity.TryGetComponent<RigidBodyComponent>()) {
                     int directionX = 0;
                     int directionY = 0;
-                    if (rigidBody.velocity.x > 0) { directionX = +1; }
-                    if (rigidBody.velocity.x < 0) { directionX = -1; }
-                    if (rigidBody.velocity.y > 0) { directionY = +1; }
-                    if (rigidBody.velocity.y < 0) { directionY = -1; }
+                    if (rigidBody->velocity.x > 0) { directionX = +1; }
+                    if (rigidBody->velocity.x < 0) { directionX = -1; }
+                    if (rigidBody->velocity.y > 0) { directionY = +1; }
+                    if (rigidBody->velocity.y < 0) { directionY = -1; }
 
                     projectileVelocity.x *= directionX;
                     projectileVelocity.y *= directionY;
                 }
 
-                projectile.AddComponent<RigidBodyComponent>(projectileVelocity);
-                projectile.AddComponent<SpriteComponent>(
-                    "bullet-image", 4, 4, 4
+                commands.AddComponent<RigidBodyComponent>(
+                    projectile, projectileVelocity
                 );
-                projectile.AddComponent<BoxColliderComponent>(4, 4);
-                projectile.AddComponent<ProjectileComponent>(
+                commands.AddComponent<ProjectileComponent>(
+                    projectile,
                     projectileEmitter.isFriendly,
                     projectileEmitter.hitPercentDamage,
                     projectileEmitter.projectileDuration
                 );
                 projectileEmitter.lastEmissionTime = SDL_GetTicks();
+                entity.MarkChanged<ProjectileEmitterComponent>();
             }
         }
     }
 
-    void Update(Registry &registry) {
+    void Update() {
         for (auto &entity : GetSystemEntities()) {
             auto &projectileEmitter =
                 entity.GetComponent<ProjectileEmitterComponent>();
+            const auto &position =
+                entity.GetComponent<PositionComponent>().position;
             const auto &transform = entity.GetComponent<TransformComponent>();
 
             if (projectileEmitter.repeatFrequency == 0 ||
@@ -98,33 +126,30 @@ public:
 
             if (SDL_GetTicks() - projectileEmitter.lastEmissionTime >
                 projectileEmitter.repeatFrequency) {
-                glm::vec2 projectilePosition = transform.position;
-                if (entity.HasComponent<SpriteComponent>()) {
-                    const auto &sprite = entity.GetComponent<SpriteComponent>();
+                glm::vec2 projectilePosition = position;
+                if (const auto *sprite =
+                        entity.TryGetComponent<SpriteComponent>()) {
                     projectilePosition.x +=
-                        transform.scale.x * sprite.width / 2;
+                        transform.scale.x * sprite->width / 2;
                     projectilePosition.y +=
-                        transform.scale.y * sprite.height / 2;
+                        transform.scale.y * sprite->height / 2;
                 }
 
-                Entity projectile = registry.CreateEntity();
-                projectile.Group("projectiles");
-                projectile.AddComponent<TransformComponent>(
-                    projectilePosition, glm::vec2(2.0, 2.0), 0.0
-                );
-                projectile.AddComponent<RigidBodyComponent>(
-                    projectileEmitter.projectileVelocity
+                const auto projectile = commands.Instantiate(projectilePrefab);
+                commands.AddComponent<PositionComponent>(
+                    projectile, projectilePosition
                 );
-                projectile.AddComponent<SpriteComponent>(
-                    "bullet-image", 4, 4, 4
+                commands.AddComponent<RigidBodyComponent>(
+                    projectile, projectileEmitter.projectileVelocity
                 );
-                projectile.AddComponent<BoxColliderComponent>(4, 4);
-                projectile.AddComponent<ProjectileComponent>(
+                commands.AddComponent<ProjectileComponent>(
+                    projectile,
                     projectileEmitter.isFriendly,
                     projectileEmitter.hitPercentDamage,
                     projectileEmitter.projectileDuration
                 );
                 projectileEmitter.lastEmissionTime = SDL_GetTicks();
+                entity.MarkChanged<ProjectileEmitterComponent>();
             }
         }
     }
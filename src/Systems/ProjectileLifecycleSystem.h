@@ -7,7 +7,10 @@
 
 class ProjectileLifecycleSystem : public System {
 public:
-    ProjectileLifecycleSystem() { RequireComponent<ProjectileComponent>(); }
+    ProjectileLifecycleSystem() {
+        RequireComponent<ProjectileComponent>();
+        ReadsComponent<ProjectileComponent>();
+    }
 
     void Update() {
         for (auto entity : GetSystemEntities()) {
@@ -2,7 +2,7 @@
 
 #include "../AssetStore/AssetStore.h"
 #include "../Components/BoxColliderComponent.h"
-#include "../Components/SpriteComponent.h"
+#include "../Components/PositionComponent.h"
 #include "../Components/TransformComponent.h"
 #include "../ECS/ECS.h"
 #include <SDL2/SDL.h>
@@ -13,27 +13,35 @@
 class RenderColliderSystem : public System {
 public:
     RenderColliderSystem() {
+        RequireComponent<PositionComponent>();
         RequireComponent<TransformComponent>();
-        RequireComponent<SpriteComponent>();
         RequireComponent<BoxColliderComponent>();
     }
 
-    void Update(SDL_Renderer *renderer, const SDL_Rect &camera) {
-        for (auto &entity : GetSystemEntities()) {
-            const auto &transform = entity.GetComponent<TransformComponent>();
-            const auto &collider = entity.GetComponent<BoxColliderComponent>();
+    void Update(
+        SDL_Renderer *renderer, const SDL_Rect &camera, Registry &registry
+    ) {
+        const auto drawCollider = [&](
+            Entity,
+            const PositionComponent &position,
+            const TransformComponent &transform,
+            const BoxColliderComponent &collider
+        ) {
             SDL_Rect colliderRect = {
                 static_cast<int>(
-                    transform.position.x + collider.offset.x - camera.x
+                    position.position.x + collider.offset.x - camera.x
                 ),
                 static_cast<int>(
-                    transform.position.y + collider.offset.y - camera.y
+                    position.position.y + collider.offset.y - camera.y
                 ),
                 static_cast<int>(collider.width * transform.scale.x),
                 static_cast<int>(collider.height * transform.scale.y)
             };
             SDL_SetRenderDrawColor(renderer, 255, 255, 0, 255);
             SDL_RenderDrawRect(renderer, &colliderRect);
-        }
+        };
+        registry
+            .View<PositionComponent, TransformComponent, BoxColliderComponent>()
+            .Each(drawCollider);
     }
 };
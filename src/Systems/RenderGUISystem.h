@@ -2,6 +2,7 @@
 
 #include "../Components/BoxColliderComponent.h"
 #include "../Components/HealthComponent.h"
+#include "../Components/PositionComponent.h"
 #include "../Components/ProjectileEmitterComponent.h"
 #include "../Components/RigidBodyComponent.h"
 #include "../Components/SpriteComponent.h"
@@ -78,8 +79,10 @@ public:
             if (ImGui::Button("Create")) {
                 Entity enemy = registry.CreateEntity();
                 enemy.Group("enemies");
+                enemy.AddComponent<PositionComponent>(
+                    glm::vec2(enemyPosX, enemyPosY)
+                );
                 enemy.AddComponent<TransformComponent>(
-                    glm::vec2(enemyPosX, enemyPosY),
                     glm::vec2(enemyScaleX, enemyScaleY),
                     glm::degrees(enemyRotation)
                 );
@@ -3,6 +3,7 @@
 #include "../AssetStore/AssetStore.h"
 #include "../Components/HealthComponent.h"
 #include "../Components/SpriteComponent.h"
+#include "../Components/PositionComponent.h"
 #include "../Components/TransformComponent.h"
 #include "../ECS/ECS.h"
 #include <SDL2/SDL.h>
@@ -11,45 +12,115 @@
 #include <SDL2/SDL_ttf.h>
 #include <algorithm>
 #include <string>
+#include <vector>
 
 class RenderHealthSystem : public System {
+private:
+    struct HealthLabel {
+        SDL_Texture *texture = nullptr;
+        SDL_Color color;
+        float healthCoeff;
+    };
+
+    // Vector index = entity ID, rebuilt only when the health changes
+    std::vector<HealthLabel> labels;
+
+    void UpdateLabel(
+        Entity entity,
+        const HealthComponent &health,
+        SDL_Renderer *renderer,
+        AssetStore &assetStore
+    ) {
+        if (entity.GetId() >= static_cast<int>(labels.size())) {
+            labels.resize(entity.GetId() + 1);
+        }
+        auto &label = labels[entity.GetId()];
+        if (label.texture) {
+            SDL_DestroyTexture(label.texture);
+        }
+
+        const std::string healthText =
+            std::to_string(health.healthPercentage) + "%";
+        label.healthCoeff =
+            std::clamp(health.healthPercentage, 0, 100) / 100.f;
+        label.color = {
+            static_cast<Uint8>(255 * (1 - label.healthCoeff)),
+            static_cast<Uint8>(255 * label.healthCoeff),
+            0,
+        };
+
+        SDL_Surface *surface = TTF_RenderText_Blended(
+            assetStore.GetFont("charriot-font"), healthText.c_str(), label.color
+        );
+        label.texture = SDL_CreateTextureFromSurface(renderer, surface);
+        SDL_FreeSurface(surface);
+    }
+
+    void OnEntityRemoved(Entity entity) override {
+        if (entity.GetId() < static_cast<int>(labels.size())) {
+            auto &label = labels[entity.GetId()];
+            if (label.texture) {
+                SDL_DestroyTexture(label.texture);
+                label.texture = nullptr;
+            }
+        }
+    }
+
 public:
     RenderHealthSystem() {
+        RequireComponent<PositionComponent>();
         RequireComponent<TransformComponent>();
         RequireComponent<SpriteComponent>();
         RequireComponent<HealthComponent>();
     }
 
+    // Must run before the renderer that created the labels is destroyed
+    ~RenderHealthSystem() {
+        for (auto &label : labels) {
+            if (label.texture) {
+                SDL_DestroyTexture(label.texture);
+            }
+        }
+    }
+
     void Update(
-        SDL_Renderer *renderer, AssetStore &assetStore, const SDL_Rect &camera
+        SDL_Renderer *renderer,
+        AssetStore &assetStore,
+        const SDL_Rect &camera,
+        Registry &registry
     ) {
+        registry.View<HealthComponent>()
+            .Changed<HealthComponent>(BeginRun(registry))
+            .Each([&](Entity entity, const HealthComponent &health) {
+                // Labels of other entities would never be released
+                if (HasEntity(entity)) {
+                    UpdateLabel(entity, health, renderer, assetStore);
+                }
+            });
+
         for (const auto &entity : GetSystemEntities()) {
+            const auto &position =
+                entity.GetComponent<PositionComponent>().position;
             const auto &transform = entity.GetComponent<TransformComponent>();
             const auto &sprite = entity.GetComponent<SpriteComponent>();
-            const auto &health = entity.GetComponent<HealthComponent>();
-            const auto &font = assetStore.GetFont("charriot-font");
+            // Entities that just joined, or rejoined without a health
+            // change, have no label yet
+            if (entity.GetId() >= static_cast<int>(labels.size()) ||
+                !labels[entity.GetId()].texture) {
+                UpdateLabel(
+                    entity,
+                    entity.GetComponent<HealthComponent>(),
+                    renderer,
+                    assetStore
+                );
+            }
+            const auto &label = labels[entity.GetId()];
 
             const int cameraOffsetX = sprite.isFixed ? 0 : camera.x;
             const int cameraOffsetY = sprite.isFixed ? 0 : camera.y;
             const int spriteWidth = sprite.width * transform.scale.x;
             const int spriteHeight = sprite.height * transform.scale.x;
 
-            const std::string healthText =
-                std::to_string(health.healthPercentage) + "%";
-            float healthCoeff =
-                std::clamp(health.healthPercentage, 0, 100) / 100.f;
-            SDL_Color color = {
-                static_cast<Uint8>(255 * (1 - healthCoeff)),
-                static_cast<Uint8>(255 * healthCoeff),
-                0,
-            };
-
-            SDL_Surface *surface =
-                TTF_RenderText_Blended(font, healthText.c_str(), color);
-            SDL_Texture *texture =
-                SDL_CreateTextureFromSurface(renderer, surface);
-            SDL_FreeSurface(surface);
-
             const int healthTextWidth = 20;
             const int healthTextHeight = 10;
             const int healthBarWidth = healthTextWidth;
@@ -57,30 +128,30 @@ public:
 
             SDL_Rect textDstRect = {
                 static_cast<int>(
-                    transform.position.x + spriteWidth - cameraOffsetX
+                    position.x + spriteWidth - cameraOffsetX
                 ),
                 static_cast<int>(
-                    transform.position.y + spriteHeight / 2.f - healthBarHeight - healthTextHeight -
+                    position.y + spriteHeight / 2.f - healthBarHeight - healthTextHeight -
                     cameraOffsetY
                 ),
                 healthTextWidth,
                 healthTextHeight,
             };
-            SDL_RenderCopy(renderer, texture, NULL, &textDstRect);
+            SDL_RenderCopy(renderer, label.texture, NULL, &textDstRect);
 
             SDL_Rect barDstRect = {
                 static_cast<int>(
-                    transform.position.x + spriteWidth - cameraOffsetX
+                    position.x + spriteWidth - cameraOffsetX
                 ),
                 static_cast<int>(
-                    transform.position.y + spriteHeight / 2.f - healthBarHeight - cameraOffsetY
+                    position.y + spriteHeight / 2.f - healthBarHeight - cameraOffsetY
                 ),
-                static_cast<int>(healthBarWidth * healthCoeff),
+                static_cast<int>(healthBarWidth * label.healthCoeff),
                 healthBarHeight
             };
+            const auto &color = label.color;
             SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, 0);
             SDL_RenderFillRect(renderer, &barDstRect);
-            SDL_DestroyTexture(texture);
         }
     }
 };
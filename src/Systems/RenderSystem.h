@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../AssetStore/AssetStore.h"
+#include "../Components/PositionComponent.h"
 #include "../Components/SpriteComponent.h"
 #include "../Components/TransformComponent.h"
 #include "../ECS/ECS.h"
@@ -8,55 +9,136 @@
 #include <SDL2/SDL_pixels.h>
 #include <SDL2/SDL_render.h>
 #include <algorithm>
+#include <iterator>
 #include <vector>
 
 struct RenderableEntity {
-    TransformComponent transformComponent;
-    SpriteComponent spriteComponent;
+    const PositionComponent *positionComponent;
+    const TransformComponent *transformComponent;
+    const SpriteComponent *spriteComponent;
+    SDL_Texture *texture;
 };
 
 class RenderSystem : public System {
+private:
+    // Reused every frame
+    std::vector<RenderableEntity> uniqueSprites;
+    std::vector<RenderableEntity> sharedSprites;
+    std::vector<RenderableEntity> renderableEntities;
+
+    static bool IsVisible(
+        const PositionComponent &p,
+        const TransformComponent &t,
+        const SpriteComponent &s,
+        const SDL_Rect &camera
+    ) {
+        bool isEntityOutsideCameraView =
+            (p.position.x + t.scale.x * s.width < camera.x ||
+             p.position.x > camera.x + camera.w ||
+             p.position.y + t.scale.y * s.height < camera.y ||
+             p.position.y > camera.y + camera.h);
+        return !isEntityOutsideCameraView || s.isFixed;
+    }
+
 public:
     RenderSystem() {
+        RequireComponent<PositionComponent>();
         RequireComponent<TransformComponent>();
         RequireComponent<SpriteComponent>();
     }
 
     void Update(
-        SDL_Renderer *renderer, AssetStore &assetStore, const SDL_Rect &camera
+        SDL_Renderer *renderer,
+        AssetStore &assetStore,
+        const SDL_Rect &camera,
+        Registry &registry
     ) {
-        std::vector<RenderableEntity> renderableEntities;
-        for (auto &entity : GetSystemEntities()) {
-            const auto &t = entity.GetComponent<TransformComponent>();
-            const auto &s = entity.GetComponent<SpriteComponent>();
+        // Both sprite pools are kept in zIndex order, and shared sprites are
+        // grouped by value within a zIndex so every texture is drawn in one
+        // run. Entities are collected in pool order and merged.
+        const bool isSorted =
+            registry.Sort<SpriteComponent>(
+                [](const SpriteComponent &a, const SpriteComponent &b) {
+                    return a.zIndex < b.zIndex;
+                }
+            ) &&
+            registry.Sort<Shared<SpriteComponent>>(
+                [&](Shared<SpriteComponent> a, Shared<SpriteComponent> b) {
+                    const int zIndexA = registry.GetShared(a).zIndex;
+                    const int zIndexB = registry.GetShared(b).zIndex;
+                    return zIndexA != zIndexB ? zIndexA < zIndexB
+                                              : a.GetIndex() < b.GetIndex();
+                }
+            );
 
-            bool isEntityOutsideCameraView =
-                (t.position.x + t.scale.x * s.width < camera.x ||
-                 t.position.x > camera.x + camera.w ||
-                 t.position.y + t.scale.y * s.height < camera.y ||
-                 t.position.y > camera.y + camera.h);
-            if (isEntityOutsideCameraView && !s.isFixed) {
-                continue;
+        const auto queueSprite = [&](
+            Entity,
+            const SpriteComponent &s,
+            const TransformComponent &t,
+            const PositionComponent &p
+        ) {
+            if (IsVisible(p, t, s, camera)) {
+                uniqueSprites.push_back(
+                    {&p, &t, &s, assetStore.GetTexture(s.assetId)}
+                );
             }
+        };
+        uniqueSprites.clear();
+        registry.View<SpriteComponent, TransformComponent, PositionComponent>()
+            .InOrderOf<SpriteComponent>()
+            .Each(queueSprite);
 
-            RenderableEntity renderableEntity{
-                t,
-                s,
-            };
-            renderableEntities.emplace_back(renderableEntity);
-        }
-
-        std::sort(
-            renderableEntities.begin(),
-            renderableEntities.end(),
-            [](RenderableEntity a, RenderableEntity b) {
-                return a.spriteComponent.zIndex < b.spriteComponent.zIndex;
+        const SpriteComponent *previousSprite = nullptr;
+        SDL_Texture *texture = nullptr;
+        const auto queueSharedSprite = [&](
+            Entity,
+            const Shared<SpriteComponent> &shared,
+            const TransformComponent &t,
+            const PositionComponent &p
+        ) {
+            const SpriteComponent &s = registry.GetShared(shared);
+            if (&s != previousSprite) {
+                previousSprite = &s;
+                texture = assetStore.GetTexture(s.assetId);
+            }
+            if (IsVisible(p, t, s, camera)) {
+                sharedSprites.push_back({&p, &t, &s, texture});
             }
+        };
+        sharedSprites.clear();
+        registry
+            .View<
+                Shared<SpriteComponent>,
+                TransformComponent,
+                PositionComponent>()
+            .InOrderOf<Shared<SpriteComponent>>()
+            .Each(queueSharedSprite);
+
+        const auto byZIndex = [](
+            const RenderableEntity &a, const RenderableEntity &b
+        ) { return a.spriteComponent->zIndex < b.spriteComponent->zIndex; };
+        if (!isSorted) {
+            std::stable_sort(
+                uniqueSprites.begin(), uniqueSprites.end(), byZIndex
+            );
+            std::stable_sort(
+                sharedSprites.begin(), sharedSprites.end(), byZIndex
+            );
+        }
+        renderableEntities.clear();
+        std::merge(
+            uniqueSprites.begin(),
+            uniqueSprites.end(),
+            sharedSprites.begin(),
+            sharedSprites.end(),
+            std::back_inserter(renderableEntities),
+            byZIndex
         );
 
         for (auto &entity : renderableEntities) {
-            const auto &transform = entity.transformComponent;
-            const auto &sprite = entity.spriteComponent;
+            const auto &position = entity.positionComponent->position;
+            const auto &transform = *entity.transformComponent;
+            const auto &sprite = *entity.spriteComponent;
 
             const int cameraOffsetX = sprite.isFixed ? 0 : camera.x;
             const int cameraOffsetY = sprite.isFixed ? 0 : camera.y;
@@ -64,14 +146,14 @@ public:
             const int spriteHeight = sprite.height * transform.scale.x;
 
             SDL_Rect dstRect = {
-                static_cast<int>(transform.position.x - cameraOffsetX),
-                static_cast<int>(transform.position.y - cameraOffsetY),
+                static_cast<int>(position.x - cameraOffsetX),
+                static_cast<int>(position.y - cameraOffsetY),
                 spriteWidth,
                 spriteHeight
             };
             SDL_RenderCopyEx(
                 renderer,
-                assetStore.GetTexture(sprite.assetId),
+                entity.texture,
                 &sprite.srcRect,
                 &dstRect,
                 transform.rotation,
@@ -0,0 +1,205 @@
+#include "../../src/ECS/ECS.h"
+#include "../../src/ECS/Prefab.h"
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Counts live instances, so leaked or doubly destroyed rows show up
+struct Name {
+    static int live;
+    std::string value;
+
+    Name(std::string value = "") : value(std::move(value)) { live++; }
+    Name(const Name &other) : value(other.value) { live++; }
+    Name(Name &&other) : value(std::move(other.value)) { live++; }
+    Name &operator=(const Name &) = default;
+    Name &operator=(Name &&) = default;
+    ~Name() { live--; }
+};
+int Name::live = 0;
+
+struct Position {
+    int x = 0;
+    Position(int x = 0) : x(x) {}
+};
+
+struct Health {
+    int value = 0;
+    Health(int value = 0) : value(value) {}
+};
+
+struct Frozen {};
+
+static std::string NameOf(int index) { return "entity-" + std::to_string(index); }
+
+static void TestMovesBetweenArchetypesKeepValues() {
+    {
+        Registry registry(ComponentStorage::Archetypes);
+        std::vector<Entity> entities;
+        for (int i = 0; i < 64; i++) {
+            Entity entity = registry.CreateEntity();
+            entity.AddComponent<Position>(i);
+            entity.AddComponent<Name>(NameOf(i));
+            entities.push_back(entity);
+        }
+        // Moving out of {Position, Name} fills the freed rows with the last
+        // rows of that archetype
+        for (int i = 0; i < 64; i += 3) {
+            entities[i].AddComponent<Health>(i * 10);
+        }
+        for (int i = 0; i < 64; i += 5) {
+            entities[i].RemoveComponent<Name>();
+        }
+        for (int i = 0; i < 64; i += 7) {
+            entities[i].Kill();
+        }
+        registry.Update();
+
+        int expectedLive = 0;
+        for (int i = 0; i < 64; i++) {
+            const Entity entity = entities[i];
+            if (i % 7 == 0) {
+                assert(!entity.IsAlive());
+                continue;
+            }
+            assert(entity.GetComponent<Position>().x == i);
+            assert(entity.HasComponent<Name>() == (i % 5 != 0));
+            if (i % 5 != 0) {
+                assert(entity.GetComponent<Name>().value == NameOf(i));
+                expectedLive++;
+            }
+            assert(entity.HasComponent<Health>() == (i % 3 == 0));
+            if (i % 3 == 0) {
+                assert(entity.GetComponent<Health>().value == i * 10);
+            }
+        }
+        assert(Name::live == expectedLive);
+    }
+    assert(Name::live == 0);
+}
+
+static void TestViewSpansArchetypesAndChunks() {
+    Registry registry(ComponentStorage::Archetypes);
+    // Enough rows for several 16 KB chunks per archetype
+    const int count = 6000;
+    long long expectedSum = 0;
+    for (int i = 0; i < count; i++) {
+        Entity entity = registry.CreateEntity();
+        entity.AddComponent<Position>(i);
+        if (i % 2 == 0) {
+            entity.AddComponent<Health>(1);
+            expectedSum += i;
+        }
+        if (i % 4 == 0) {
+            entity.AddComponent<Name>(NameOf(i));
+        }
+    }
+
+    int visited = 0;
+    long long sum = 0;
+    registry.View<Position, Health>().Each(
+        [&](Entity entity, Position &position, Health &health) {
+            assert(position.x == static_cast<int>(entity.GetId()));
+            sum += position.x * health.value;
+            visited++;
+        }
+    );
+    assert(visited == count / 2);
+    assert(sum == expectedSum);
+
+    visited = 0;
+    registry.View<Position>().Each([&](Entity, Position &) { visited++; });
+    assert(visited == count);
+}
+
+static void TestClearAndShrink() {
+    {
+        Registry registry(ComponentStorage::Archetypes);
+        std::vector<Entity> entities;
+        for (int i = 0; i < 3000; i++) {
+            Entity entity = registry.CreateEntity();
+            entity.AddComponent<Position>(i);
+            entity.AddComponent<Name>(NameOf(i));
+            entities.push_back(entity);
+        }
+        registry.Update();
+
+        // Enough kills to start a compaction pass, which shrinks the chunks
+        for (int i = 0; i < 3000; i++) {
+            if (i % 3 != 0) {
+                entities[i].Kill();
+            }
+        }
+        registry.Update();
+        registry.Compact(std::chrono::seconds(10));
+        assert(Name::live == 1000);
+        for (int i = 0; i < 3000; i += 3) {
+            assert(entities[i].GetComponent<Position>().x == i);
+            assert(entities[i].GetComponent<Name>().value == NameOf(i));
+        }
+
+        registry.Clear();
+        assert(Name::live == 0);
+        int visited = 0;
+        registry.View<Position>().Each([&](Entity, Position &) { visited++; });
+        assert(visited == 0);
+
+        Entity entity = registry.CreateEntity();
+        entity.AddComponent<Position>(7);
+        entity.AddComponent<Name>("after-clear");
+        assert(entity.GetComponent<Position>().x == 7);
+        assert(entity.GetComponent<Name>().value == "after-clear");
+        assert(!entities[0].IsAlive());
+    }
+    assert(Name::live == 0);
+}
+
+static void TestInstantiateFillsPrefabArchetype() {
+    {
+        Registry registry(ComponentStorage::Archetypes);
+        Prefab prefab;
+        prefab.AddComponent<Position>(3)
+            .AddComponent<Name>("prefab")
+            .AddComponent<Frozen>();
+        auto entities = registry.Instantiate(
+            prefab,
+            3000,
+            [](Entity entity, int index) {
+                entity.GetComponent<Position>().x += index;
+            }
+        );
+        // Plus the prefab's own value
+        assert(Name::live == 3001);
+        for (int i = 0; i < 3000; i++) {
+            assert(entities[i].HasComponent<Frozen>());
+            assert(entities[i].GetComponent<Position>().x == 3 + i);
+            assert(entities[i].GetComponent<Name>().value == "prefab");
+        }
+
+        // Instances share one archetype with entities built one by one
+        Entity entity = registry.CreateEntity();
+        entity.AddComponent<Name>("single");
+        entity.AddComponent<Position>(-1);
+        int visited = 0;
+        registry.View<Position, Name>().Each([&](Entity, Position &, Name &) {
+            visited++;
+        });
+        assert(visited == 3001);
+        entities[0].Kill();
+        registry.Update();
+        assert(entity.GetComponent<Name>().value == "single");
+        assert(entities[2999].GetComponent<Position>().x == 3002);
+    }
+    assert(Name::live == 0);
+}
+
+int main() {
+    TestMovesBetweenArchetypesKeepValues();
+    TestViewSpansArchetypesAndChunks();
+    TestClearAndShrink();
+    TestInstantiateFillsPrefabArchetype();
+    std::cout << "ArchetypeTest passed" << std::endl;
+    return 0;
+}
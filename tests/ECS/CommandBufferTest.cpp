@@ -0,0 +1,41 @@
+#include "../../src/ECS/CommandBuffer.h"
+#include <cassert>
+#include <iostream>
+
+struct Health {
+    int value;
+    Health(int value = 0) : value(value) {}
+};
+
+static void TestRemoveThenAddReplaces() {
+    Registry registry;
+    auto &commands = registry.CreateCommandBuffer();
+    Entity entity = registry.CreateEntity();
+    entity.AddComponent<Health>(10);
+
+    commands.RemoveComponent<Health>(entity);
+    commands.AddComponent<Health>(entity, 20);
+    commands.Playback(registry);
+
+    assert(entity.HasComponent<Health>());
+    assert(entity.GetComponent<Health>().value == 20);
+}
+
+static void TestAddThenRemoveRemoves() {
+    Registry registry;
+    auto &commands = registry.CreateCommandBuffer();
+    Entity entity = registry.CreateEntity();
+
+    commands.AddComponent<Health>(entity, 20);
+    commands.RemoveComponent<Health>(entity);
+    commands.Playback(registry);
+
+    assert(!entity.HasComponent<Health>());
+}
+
+int main() {
+    TestRemoveThenAddReplaces();
+    TestAddThenRemoveRemoves();
+    std::cout << "CommandBufferTest passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,42 @@
+#include "../../src/ECS/ECS.h"
+#include <cassert>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+template <int I> struct Extra {
+    int value;
+};
+
+template <int... Is>
+static int CountAssignedIds(std::integer_sequence<int, Is...>) {
+    int assigned = 0;
+    bool threw = false;
+    const auto assign = [&](auto getId) {
+        if (threw) {
+            return;
+        }
+        try {
+            const int id = getId();
+            assert(id < static_cast<int>(MAX_COMPONENTS));
+            assigned++;
+        } catch (const std::length_error &) {
+            threw = true;
+        }
+    };
+    (assign([] { return Component<Extra<Is>>::GetId(); }), ...);
+    assert(threw);
+    return assigned;
+}
+
+static void TestRuntimeIdsStopAtMaxComponents() {
+    const int assigned =
+        CountAssignedIds(std::make_integer_sequence<int, MAX_COMPONENTS>());
+    assert(assigned == static_cast<int>(MAX_COMPONENTS - ComponentTypes::size));
+}
+
+int main() {
+    TestRuntimeIdsStopAtMaxComponents();
+    std::cout << "ComponentTest passed" << std::endl;
+    return 0;
+}
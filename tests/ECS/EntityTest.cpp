@@ -0,0 +1,100 @@
+#include "../../src/ECS/Prefab.h"
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+struct Value {
+    int id = 0;
+    Value(int id = 0) : id(id) {}
+};
+
+static void TestEntityLimitThrows() {
+    Registry registry;
+    const int limit = ENTITY_INDEX_MASK + 1;
+    const auto entities = registry.Instantiate(Prefab(), limit);
+    assert(entities.back().GetId() == limit - 1);
+
+    bool threw = false;
+    try {
+        registry.CreateEntity();
+    } catch (const std::length_error &) {
+        threw = true;
+    }
+    assert(threw);
+
+    threw = false;
+    try {
+        registry.Instantiate(Prefab(), 1);
+    } catch (const std::length_error &) {
+        threw = true;
+    }
+    assert(threw);
+    assert(entities.front().IsAlive());
+    assert(registry.GetEntity(0) == entities.front());
+}
+
+static void TestCompactionResumesAcrossCalls() {
+    Registry registry;
+    Prefab prefab;
+    prefab.AddComponent<Value>();
+    const auto entities = registry.Instantiate(
+        prefab,
+        40000,
+        [](Entity entity, int) {
+            entity.GetComponent<Value>().id = entity.GetId();
+        }
+    );
+    registry.Update();
+    // Every other ID below 20000 and the whole top half become free
+    std::vector<Entity> live;
+    for (auto entity : entities) {
+        if (entity.GetId() < 20000 && entity.GetId() % 2 == 1) {
+            live.push_back(entity);
+        } else {
+            entity.Kill();
+        }
+    }
+    registry.Update();
+
+    // A zero budget runs one unit of work per call, while entities come and
+    // go between the calls
+    for (int frame = 0; frame < 100; frame++) {
+        registry.Compact(std::chrono::microseconds(0));
+        Entity entity = registry.CreateEntity();
+        assert(entity.GetId() < 20000);
+        entity.AddComponent<Value>(entity.GetId());
+        live[frame].Kill();
+        live.push_back(entity);
+        registry.Update();
+    }
+    registry.Compact(std::chrono::seconds(10));
+
+    std::vector<bool> seen(20000);
+    for (size_t i = 100; i < live.size(); i++) {
+        const Entity entity = live[i];
+        assert(entity.IsAlive());
+        assert(entity.GetComponent<Value>().id == entity.GetId());
+        assert(!seen[entity.GetId()]);
+        seen[entity.GetId()] = true;
+    }
+
+    // The top half was trimmed, so new IDs continue right above the free
+    // ones below 20000
+    int created = 0;
+    Entity entity = registry.CreateEntity();
+    for (; entity.GetId() < 20000; entity = registry.CreateEntity()) {
+        assert(!seen[entity.GetId()]);
+        created++;
+    }
+    assert(entity.GetId() == 20000);
+    assert(created == 20000 - static_cast<int>(live.size()) + 100);
+}
+
+int main() {
+    TestEntityLimitThrows();
+    TestCompactionResumesAcrossCalls();
+    std::cout << "EntityTest passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,184 @@
+#include "../../src/ECS/ECS.h"
+#include <cassert>
+#include <iostream>
+#include <vector>
+
+struct Position {
+    float x = 0;
+};
+
+struct Marker {
+    int value = 0;
+    Marker(int value = 0) : value(value) {}
+};
+
+class TrackingSystem : public System {
+private:
+    void OnEntityRemoved(Entity entity) override {
+        removed.push_back(entity.GetId());
+    }
+
+public:
+    std::vector<int> removed;
+
+    TrackingSystem() { RequireComponent<Position>(); }
+};
+
+static void TestRemovalHookRunsOnEveryRemovalPath() {
+    Registry registry;
+    registry.AddSystem<TrackingSystem>();
+    auto &system = registry.GetSystem<TrackingSystem>();
+
+    std::vector<Entity> entities;
+    for (int i = 0; i < 8; i++) {
+        entities.push_back(registry.CreateEntity());
+        entities.back().AddComponent<Position>();
+    }
+    registry.Update();
+
+    // Losing a required component
+    entities[0].RemoveComponent<Position>();
+    registry.Update();
+    assert(system.removed == std::vector<int>{0});
+
+    // A single kill takes the swap-and-pop path
+    entities[1].Kill();
+    registry.Update();
+    assert(system.removed.size() == 2 && system.removed[1] == 1);
+
+    // Killing most of the system takes the compacting path
+    for (int i = 2; i < 7; i++) {
+        entities[i].Kill();
+    }
+    registry.Update();
+    assert(system.removed.size() == 7);
+
+    registry.Clear();
+    assert(system.removed.size() == 8 && system.removed.back() == 7);
+    assert(system.GetSystemEntities().empty());
+}
+
+// Writes structural changes from every chunk of a parallel loop
+class ChunkWritingSystem : public System {
+public:
+    ChunkWritingSystem() { RequireComponent<Position>(); }
+
+    void Update() {
+        ParallelForEach(64, [](Entity entity) {
+            const int id = entity.GetId();
+            if (id % 4 == 0) {
+                entity.AddComponent<Marker>(id);
+            } else if (id % 4 == 1) {
+                entity.RemoveComponent<Position>();
+            } else if (id % 4 == 2) {
+                entity.Kill();
+            } else {
+                entity.SetEnabled(false);
+                entity.Group(3);
+                auto *commands = Registry::GetDeferredCommands();
+                const auto created = commands->CreateEntity();
+                commands->AddComponent<Marker>(created, -id);
+            }
+            // Deferred until every chunk is done
+            assert(!entity.HasComponent<Marker>());
+            assert(entity.IsEnabled());
+        });
+    }
+};
+
+static void TestParallelChunksDeferStructuralChanges() {
+    ThreadPool threadPool(4);
+    Registry registry;
+    registry.SetThreadPool(&threadPool);
+    registry.AddSystem<ChunkWritingSystem>();
+
+    const int count = 2000;
+    std::vector<Entity> entities;
+    for (int i = 0; i < count; i++) {
+        entities.push_back(registry.CreateEntity());
+        entities.back().AddComponent<Position>();
+    }
+    registry.Update();
+    registry.GetSystem<ChunkWritingSystem>().Update();
+    registry.Update();
+
+    int created = 0;
+    registry.View<Marker>().Each([&](Entity entity, Marker &marker) {
+        if (marker.value < 0) {
+            created++;
+            assert(entity.GetId() >= count);
+        }
+    });
+    assert(created == count / 4);
+    for (int i = 0; i < count; i++) {
+        const Entity entity = entities[i];
+        switch (i % 4) {
+        case 0:
+            assert(entity.GetComponent<Marker>().value == i);
+            break;
+        case 1:
+            assert(!entity.HasComponent<Position>());
+            break;
+        case 2:
+            assert(!entity.IsAlive());
+            break;
+        default:
+            assert(!entity.IsEnabled());
+            assert(entity.BelongsToGroup(3));
+        }
+    }
+}
+
+class PairSystem : public System {
+public:
+    PairSystem() {
+        RequireComponent<Position>();
+        RequireComponent<Marker>();
+    }
+};
+
+static void TestSortAsSystemEntitiesAlignsPools() {
+    Registry registry;
+    registry.AddSystem<PairSystem>();
+    const auto &entities = registry.GetSystem<PairSystem>().GetSystemEntities();
+
+    std::vector<Entity> all;
+    for (int i = 0; i < 3000; i++) {
+        Entity entity = registry.CreateEntity();
+        // Some entities only have one of the two
+        if (i % 5 != 0) {
+            entity.AddComponent<Marker>(i);
+        }
+        if (i % 7 != 0) {
+            entity.AddComponent<Position>();
+        }
+        all.push_back(entity);
+    }
+    registry.Update();
+
+    for (int round = 0; round < 3; round++) {
+        assert(registry.SortAs<Position>(entities));
+        assert(registry.SortAs<Marker>(entities));
+        auto &positions = registry.GetPool<Position>();
+        auto &markers = registry.GetPool<Marker>();
+        for (unsigned int i = 0; i < entities.size(); i++) {
+            const int id = entities[i].GetId();
+            assert(positions.GetEntityId(i) == id);
+            assert(markers.GetEntityId(i) == id);
+            assert(markers[i].value == id);
+        }
+        // Removals reorder the system and both pools differently
+        for (int i = round; i < 3000; i += 11) {
+            all[i].Kill();
+        }
+        registry.Update();
+    }
+}
+
+int main() {
+    TestRemovalHookRunsOnEveryRemovalPath();
+    TestParallelChunksDeferStructuralChanges();
+    TestSortAsSystemEntitiesAlignsPools();
+    std::cout << "SystemTest passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,53 @@
+#include "../../src/ECS/ECS.h"
+#include <cassert>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+template <typename TFunc> static bool Throws(TFunc func) {
+    try {
+        func();
+    } catch (const std::exception &) {
+        return true;
+    }
+    return false;
+}
+
+static void TestGetEntityByTagThrowsWithoutEntity() {
+    Registry registry;
+    assert(Throws([&] { registry.GetEntityByTag("never-used"); }));
+
+    Entity entity = registry.CreateEntity();
+    entity.Tag("player");
+    assert(registry.GetEntityByTag("player") == entity);
+    registry.RemoveEntityTag(entity);
+    assert(Throws([&] { registry.GetEntityByTag("player"); }));
+}
+
+static void TestInvalidIdsThrow() {
+    Registry registry;
+    Entity entity = registry.CreateEntity();
+    assert(Throws([&] { registry.TagEntity(entity, -1); }));
+    assert(Throws([&] { registry.TagEntity(entity, MAX_TAGS); }));
+    assert(Throws([&] { registry.GroupEntity(entity, -1); }));
+    assert(Throws([&] { registry.GroupEntity(entity, MAX_GROUPS); }));
+}
+
+static void TestNameLimitThrows() {
+    bool threw = false;
+    for (int i = 0; i <= MAX_TAGS && !threw; i++) {
+        threw = Throws([&] {
+            const int tagId = Registry::GetTagId("tag" + std::to_string(i));
+            assert(tagId >= 0 && tagId < MAX_TAGS);
+        });
+    }
+    assert(threw);
+}
+
+int main() {
+    TestGetEntityByTagThrowsWithoutEntity();
+    TestInvalidIdsThrow();
+    TestNameLimitThrows();
+    std::cout << "TagTest passed" << std::endl;
+    return 0;
+}
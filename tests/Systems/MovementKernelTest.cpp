@@ -0,0 +1,81 @@
+#include "../../src/Systems/MovementKernel.h"
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+static const float WIDTH = 100;
+static const float HEIGHT = 50;
+static const float DELTA_TIME = 0.5f;
+
+// Positions on, inside and just past every edge, NaN, and counts that leave
+// a tail for each vector width
+static void TestKernelsMatchScalarLoop() {
+    const float xs[] = {-1, 0, 40, 100, 101, NAN};
+    const float ys[] = {-1, 0, 20, 50, 51, NAN};
+    for (int count = 0; count <= 41; count++) {
+        std::vector<float> positions;
+        std::vector<float> velocities;
+        for (int i = 0; i < count; i++) {
+            positions.push_back(xs[i % 6]);
+            positions.push_back(ys[i / 6 % 6]);
+            velocities.push_back(i % 3 - 1);
+            velocities.push_back(i % 5 == 0 ? 2 : 0);
+        }
+
+        std::vector<float> expectedPositions = positions;
+        std::vector<int> expected(count);
+        expected.resize(MovementKernel::IntegrateScalar(
+            expectedPositions.data(),
+            velocities.data(),
+            0,
+            count,
+            DELTA_TIME,
+            WIDTH,
+            HEIGHT,
+            expected.data()
+        ));
+
+        std::vector<float> actualPositions = positions;
+        std::vector<int> actual(count);
+        actual.resize(MovementKernel::Integrate(
+            actualPositions.data(),
+            velocities.data(),
+            count,
+            DELTA_TIME,
+            WIDTH,
+            HEIGHT,
+            actual.data()
+        ));
+        assert(actual == expected);
+        for (int i = 0; i < 2 * count; i++) {
+            assert(
+                actualPositions[i] == expectedPositions[i] ||
+                (std::isnan(actualPositions[i]) &&
+                 std::isnan(expectedPositions[i]))
+            );
+        }
+
+#ifdef MOVEMENT_KERNEL_X86_64
+        actualPositions = positions;
+        actual.assign(count, 0);
+        actual.resize(MovementKernel::IntegrateSse(
+            actualPositions.data(),
+            velocities.data(),
+            0,
+            count,
+            DELTA_TIME,
+            WIDTH,
+            HEIGHT,
+            actual.data()
+        ));
+        assert(actual == expected);
+#endif
+    }
+}
+
+int main() {
+    TestKernelsMatchScalarLoop();
+    std::cout << "MovementKernelTest passed" << std::endl;
+    return 0;
+}